@@ -0,0 +1,400 @@
+/*
+ * Benchmarks for the text- and render-hot-paths of WiTUI.
+ *
+ * Every result is printed as one JSON-object per line on stdout, so the
+ * output can be diffed or fed to other tools:
+ * {"benchmark": "...", "corpus": "...", "bytes": ..., "iterations": ...,
+ *  "ns_per_op": ..., "mb_per_s": ...}
+ *
+ * Usage: bench.out [filter]
+ * Only benchmarks whose name contains `filter` are run.
+ */
+
+#include "wi_tui.h"
+#include "wi_internals.h"
+
+#include <limits.h>		/* INT_MAX */
+#include <stdatomic.h>	/* atomic_store() */
+#include <stdio.h>		/* printf() */
+#include <stdlib.h>		/* malloc(), free() */
+#include <string.h>		/* strstr(), memcpy() */
+#include <time.h>		/* clock_gettime() */
+
+/* Size of the generated corpora */
+#define CORPUS_BYTES (4 * 1024 * 1024)
+
+/* A benchmark runs at least this long, to get stable numbers */
+#define MIN_BENCH_NS 200000000LL
+
+typedef struct {
+	const char* name;
+	char* text;
+	size_t bytes;
+} corpus;
+
+static const char* filter = NULL;
+
+/* Anti-optimisation sink, so results of benchmarked calls are used */
+static volatile unsigned int sink;
+
+static long long now_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/* Deterministic pseudo-random numbers, so every run uses the same corpora */
+static unsigned int next_random(void) {
+	static unsigned long long state = 0x2545F4914F6CDD1DULL;
+	state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (unsigned int) (state >> 33);
+}
+
+/*
+ * Build a corpus out of words, separated by spaces and newlines.
+ * `words` are picked at random; lines are 20 to 140 bytes long.
+ */
+static corpus make_corpus(
+	const char* name, const char* const* words, const int amount_words
+) {
+	/* Two extra nullbytes: `split_lines_wrapped()` looks one byte ahead */
+	char* text = (char*) calloc(CORPUS_BYTES + 2, 1);
+	size_t bytes = 0;
+	size_t line_start = 0;
+	size_t line_length = 20 + next_random() % 120;
+
+	while (true) {
+		const char* word = words[next_random() % amount_words];
+		const size_t word_bytes = strlen(word);
+		if (bytes + word_bytes + 1 > CORPUS_BYTES) {
+			break;
+		}
+
+		memcpy(text + bytes, word, word_bytes);
+		bytes += word_bytes;
+
+		if (bytes - line_start >= line_length) {
+			text[bytes++] = '\n';
+			line_start = bytes;
+			line_length = 20 + next_random() % 120;
+		} else {
+			text[bytes++] = ' ';
+		}
+	}
+	text[bytes] = '\0';
+
+	return (corpus) { .name = name, .text = text, .bytes = bytes };
+}
+
+static const char* const ascii_words[] = {
+	"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog",
+	"terminal", "window", "border", "content", "render", "session", "a", "of"
+};
+
+static const char* const utf8_words[] = {
+	"caf\xC3\xA9", "na\xC3\xAFve", "\xE2\x82\xAC" "42", "gr\xC3\xBC\xC3\x9F",
+	"\xE2\x94\x80\xE2\x94\x80\xE2\x94\x80", "\xF0\x9D\x84\x9E", "plain",
+	"\xCE\xB1\xCE\xB2\xCE\xB3", "\xD0\xBF\xD1\x80\xD0\xB8", "text", "\xE2\x86\x92"
+};
+
+static const char* const ansi_words[] = {
+	"\033[31mred\033[0m", "\033[1;32mbold-green\033[0m", "plain",
+	"\033[38;5;208morange\033[0m", "\033[4munderlined\033[0m", "text",
+	"\033[33mwarn\033[0m:", "\033[38;2;10;20;30mtrue-colour\033[0m"
+};
+
+#define AMOUNT(array) ((int) (sizeof(array) / sizeof(array[0])))
+
+/*
+ * Print one result-line.
+ * `bytes` is the amount of bytes processed per operation, used for MB/s.
+ */
+static void report(
+	const char* benchmark, const char* corpus_name, const size_t bytes,
+	const long long iterations, const long long elapsed_ns
+) {
+	const double ns_per_op = (double) elapsed_ns / iterations;
+	const double mb_per_s = bytes == 0
+		? 0.0 : ((double) bytes / (1024.0 * 1024.0)) / (ns_per_op / 1e9);
+
+	printf(
+		"{\"benchmark\": \"%s\", \"corpus\": \"%s\", \"bytes\": %zu, "
+		"\"iterations\": %lld, \"ns_per_op\": %.2f, \"mb_per_s\": %.2f}\n",
+		benchmark, corpus_name, bytes, iterations, ns_per_op, mb_per_s
+	);
+	fflush(stdout);
+}
+
+static bool selected(const char* benchmark) {
+	return filter == NULL || strstr(benchmark, filter) != NULL;
+}
+
+/*
+ * Run `op` until MIN_BENCH_NS passed, doubling the batch-size each time.
+ * @returns: elapsed nanoseconds, and the amount of iterations in `*iterations`
+ */
+static long long run_batches(
+	void (*op)(void*), void* arg, long long* iterations
+) {
+	long long batch = 1;
+	long long total = 0;
+	long long elapsed = 0;
+
+	/* Warm up caches and the allocator */
+	op(arg);
+
+	while (elapsed < MIN_BENCH_NS) {
+		const long long start = now_ns();
+		for (long long i = 0; i < batch; i++) {
+			op(arg);
+		}
+		elapsed += now_ns() - start;
+		total += batch;
+		batch *= 2;
+	}
+
+	*iterations = total;
+	return elapsed;
+}
+
+
+
+/* ------------------
+ * Micro-benchmarks
+ * ------------------ */
+
+static void op_char_byte_size(void* arg) {
+	const corpus* c = (const corpus*) arg;
+	unsigned int width = 0;
+	size_t i = 0;
+	while (i < c->bytes) {
+		const wi_string_length length = wi_char_byte_size(c->text + i);
+		width += length.width;
+		i += length.bytes;
+	}
+	sink = width;
+}
+
+static void op_strlen(void* arg) {
+	const corpus* c = (const corpus*) arg;
+	sink = wi_strlen(c->text).width;
+}
+
+static void op_split_lines(void* arg) {
+	const corpus* c = (const corpus*) arg;
+	wi_content content = split_lines(c->text);
+	sink = content.amount_lines;
+	wi_free_content(content);
+}
+
+static void op_split_lines_wrapped(void* arg) {
+	const corpus* c = (const corpus*) arg;
+	wi_content content = split_lines_wrapped(c->text, 80);
+	sink = content.amount_lines;
+	wi_free_content(content);
+}
+
+static void bench_text(const corpus* corpora, const int amount_corpora) {
+	const struct {
+		const char* name;
+		void (*op)(void*);
+	} benchmarks[] = {
+		{ "wi_char_byte_size", op_char_byte_size },
+		{ "wi_strlen", op_strlen },
+		{ "split_lines", op_split_lines },
+		{ "split_lines_wrapped", op_split_lines_wrapped },
+	};
+
+	for (int b = 0; b < AMOUNT(benchmarks); b++) {
+		if (!selected(benchmarks[b].name)) {
+			continue;
+		}
+		for (int c = 0; c < amount_corpora; c++) {
+			long long iterations;
+			const long long elapsed = run_batches(
+				benchmarks[b].op, (void*) &(corpora[c]), &iterations
+			);
+			report(
+				benchmarks[b].name, corpora[c].name, corpora[c].bytes,
+				iterations, elapsed
+			);
+		}
+	}
+}
+
+
+
+/* ------------------
+ * Macro-benchmarks
+ * ------------------ */
+
+#define GRID_ROWS 6
+#define GRID_COLS 8
+#define WINDOW_CONTENT_BYTES (16 * 1024)
+#define SCREEN_ROWS 60
+#define SCREEN_COLS 240
+
+typedef struct {
+	wi_session* session;
+	char* contents[GRID_ROWS * GRID_COLS];
+	char* frame;
+	size_t frame_capacity;
+	size_t frame_bytes;
+	size_t content_bytes;
+	int resize_step;
+} grid_session;
+
+/*
+ * Make a session with a grid of windows, each showing a slice of the corpus.
+ * Every window has a flexible width, so a resize touches all of them.
+ */
+static grid_session make_grid_session(const corpus* c, const bool wrap) {
+	grid_session grid = { .session = wi_make_session(false) };
+	grid.session->diff_rendering = false;
+
+	for (int row = 0; row < GRID_ROWS; row++) {
+		for (int col = 0; col < GRID_COLS; col++) {
+			const int index = row * GRID_COLS + col;
+			const size_t offset =
+				((size_t) index * WINDOW_CONTENT_BYTES) % (c->bytes - WINDOW_CONTENT_BYTES);
+
+			/* Start and end at a character-boundary */
+			int start = (int) offset;
+			skip_continuation_bytes_right(&start, c->text, (int) c->bytes);
+			int end = start + WINDOW_CONTENT_BYTES;
+			skip_continuation_bytes_left(&end, c->text);
+
+			char* content = (char*) calloc(end - start + 2, 1);
+			memcpy(content, c->text + start, end - start);
+			grid.contents[index] = content;
+			grid.content_bytes += end - start;
+
+			wi_window* window = wi_make_window();
+			window->width = -1;
+			window->height = SCREEN_ROWS / GRID_ROWS - 2;
+			window->wrap_text = wrap;
+			wi_add_content_to_window(window, content, (wi_position) { 0, 0 });
+			wi_add_window_to_session(grid.session, window, row);
+		}
+	}
+
+	grid.frame_capacity = 1024 * 1024;
+	grid.frame = (char*) malloc(grid.frame_capacity);
+
+	/* First frame sets up the sizes and wraps the content */
+	wi_render_frame_to_buffer(
+		grid.session, SCREEN_ROWS, SCREEN_COLS, grid.frame, grid.frame_capacity
+	);
+
+	return grid;
+}
+
+static void free_grid_session(grid_session* grid) {
+	wi_free_session(grid->session);
+	for (int i = 0; i < GRID_ROWS * GRID_COLS; i++) {
+		free(grid->contents[i]);
+	}
+	free(grid->frame);
+}
+
+/* Render a complete frame, every window redrawn */
+static void op_render_frame(void* arg) {
+	grid_session* grid = (grid_session*) arg;
+	wi_session* session = grid->session;
+
+	for (int row = 0; row < session->internal.amount_rows; row++) {
+		for (int col = 0; col < session->internal.amount_cols[row]; col++) {
+			atomic_store(&(session->windows[row][col]->internal.dirty), true);
+		}
+	}
+	grid->frame_bytes = wi_render_frame_to_buffer(
+		session, SCREEN_ROWS, SCREEN_COLS, grid->frame, grid->frame_capacity
+	);
+}
+
+/*
+ * Widths a resize cycles through, more than a wrap-cache remembers, so that
+ * every resize has to wrap again
+ */
+#define RESIZE_WIDTHS (4 * WI_WRAP_CACHE_ENTRIES)
+
+/*
+ * Re-calculate all content for a new width, like a terminal-resize does.
+ * Wrapping normally stops at the cursor and goes on lazily, here all of the
+ * content gets wrapped, so that the throughput is over all of its bytes.
+ */
+static void op_resize(void* arg) {
+	grid_session* grid = (grid_session*) arg;
+	wi_session* session = grid->session;
+	grid->resize_step++;
+	const int delta =
+		grid->resize_step % RESIZE_WIDTHS == 0 ? 1 - RESIZE_WIDTHS : 1;
+
+	for (int row = 0; row < session->internal.amount_rows; row++) {
+		for (int col = 0; col < session->internal.amount_cols[row]; col++) {
+			wi_window* window = session->windows[row][col];
+			window->internal.rendered_width += delta;
+			wi_update_content(window);
+
+			wi_content* content = current_window_content(window);
+			continue_split_lines(content, INT_MAX, INT_MAX);
+			wrap_window_prefix(window, content, INT_MAX);
+		}
+	}
+}
+
+static void bench_render(const corpus* corpora, const int amount_corpora) {
+	for (int c = 0; c < amount_corpora; c++) {
+		long long iterations;
+		long long elapsed;
+
+		if (selected("render_frame")) {
+			grid_session grid = make_grid_session(&(corpora[c]), false);
+			elapsed = run_batches(op_render_frame, &grid, &iterations);
+			/* For rendering, the throughput is in bytes sent to the terminal */
+			report("render_frame", corpora[c].name, grid.frame_bytes, iterations, elapsed);
+			free_grid_session(&grid);
+		}
+
+		if (selected("render_frame_wrapped")) {
+			grid_session grid = make_grid_session(&(corpora[c]), true);
+			elapsed = run_batches(op_render_frame, &grid, &iterations);
+			report(
+				"render_frame_wrapped", corpora[c].name, grid.frame_bytes,
+				iterations, elapsed
+			);
+			free_grid_session(&grid);
+		}
+
+		if (selected("resize_update_content")) {
+			grid_session grid = make_grid_session(&(corpora[c]), true);
+			elapsed = run_batches(op_resize, &grid, &iterations);
+			report(
+				"resize_update_content", corpora[c].name, grid.content_bytes,
+				iterations, elapsed
+			);
+			free_grid_session(&grid);
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1) {
+		filter = argv[1];
+	}
+
+	const corpus corpora[] = {
+		make_corpus("ascii", ascii_words, AMOUNT(ascii_words)),
+		make_corpus("utf8", utf8_words, AMOUNT(utf8_words)),
+		make_corpus("ansi", ansi_words, AMOUNT(ansi_words)),
+	};
+
+	bench_text(corpora, AMOUNT(corpora));
+	bench_render(corpora, AMOUNT(corpora));
+
+	for (int c = 0; c < AMOUNT(corpora); c++) {
+		free(corpora[c].text);
+	}
+
+	return 0;
+}
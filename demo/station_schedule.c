@@ -1,8 +1,36 @@
 #include "wi_data.h"
 #include "wi_functions.h"
 
+#include <stdatomic.h>	/* atomic_bool */
 #include <stdio.h>		/* printf() */
 #include <stdlib.h>		/* exit() */
+#include <threads.h>	/* thrd_create(), thrd_sleep() */
+#include <time.h>		/* time(), strftime() */
+
+static atomic_bool clock_running = true;
+
+/*
+ * Show the current time in the footer of the table, from its own thread.
+ * The footer is written in the buffer that isn't shown, so the render-thread
+ * never reads a half-written one.
+ */
+int run_clock(void* arg) {
+	wi_window* window = (wi_window*) arg;
+	static char footers[2][16];
+	int next = 0;
+
+	while (atomic_load(&clock_running)) {
+		const time_t now = time(NULL);
+		strftime(footers[next], sizeof(footers[next]), " %H:%M:%S ", localtime(&now));
+		window->border.footer = footers[next];
+		next = 1 - next;
+		wi_mark_window_dirty(window);
+
+		thrd_sleep(&(struct timespec) { .tv_sec = 1 }, NULL);
+	}
+
+	return 0;
+}
 
 void show_and_exit(const char key, wi_session* session) {
 	wi_quit_rendering_and_wait(key, session);
@@ -193,6 +221,13 @@ int main(void) {
 	 * and 'enter' erases table and shows the extra info for the selection. */
 	wi_add_keymap_to_session(session, '\n', NONE, show_and_exit);
 
+	/* Keep a clock in the footer of the table */
+	window_table->border.footer_alignment = RIGHT;
+	thrd_t clock_thread;
+	thrd_create(&clock_thread, run_clock, window_table);
+
 	wi_show_session(session);
+	atomic_store(&clock_running, false);
+	thrd_join(clock_thread, NULL);
 	wi_free_session(session);
 }
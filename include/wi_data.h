@@ -3,6 +3,8 @@
 
 #include <stdbool.h>	/* bool */
 #include <stdatomic.h>	/* atomic_bool */
+#include <stddef.h>		/* size_t */
+#include <threads.h>	/* mtx_t */
 
 /*
  * Some of the comments are bad comments. They tell what you clearly see,
@@ -44,19 +46,122 @@ typedef struct wi_string_length wi_string_length;
  */
 typedef struct wi_content wi_content;
 
+/*
+ * A place in a line to start walking from when skipping to a column:
+ * the `.bytes` and visual `.width` up to there.
+ */
+typedef struct wi_column_checkpoint wi_column_checkpoint;
+
+/*
+ * An escape-sequence in a line: where it starts, how long it is, and the
+ * visual column of the character it applies from.
+ */
+typedef struct wi_style_span wi_style_span;
+
+/*
+ * The markup a wrapped line goes on in, from the lines wrapped from the same
+ * line of the original before it: where replaying it starts.
+ */
+typedef struct wi_carried_style wi_carried_style;
+
+/*
+ * What is known about one line of a `wi_content`: its column-checkpoints
+ * and style-spans, both built the first time the line needs them.
+ */
+typedef struct wi_line_index wi_line_index;
+
+/*
+ * A `wi_line_index` per line of a `wi_content`.
+ */
+typedef struct wi_column_index wi_column_index;
+
+/*
+ * The lines of wrapped content before `.end`, that are wrapped after the
+ * lines from `.end` on: `.bytes` of them are wrapped into `.lines` so far.
+ */
+typedef struct wi_wrap_prefix wi_wrap_prefix;
+
+/*
+ * The wrapped lines of a `wi_content` for widths it was wrapped for before,
+ * so that going back to such a width doesn't need rewrapping.
+ * Most recently used first, limited by `.wrap_cache_size` of the session.
+ */
+typedef struct wi_wrap_cache wi_wrap_cache;
+
+/*
+ * The buffers of content with a fixed size, see
+ * `wi_add_bounded_content_to_window()`. The text and the lines are both
+ * mapped twice in a row, so `.original` and `.line_list` of the content can
+ * run past the end and continue at the start, without anything noticing.
+ */
+typedef struct wi_ring wi_ring;
+
+/*
+ * A growable byte-buffer in which a whole frame gets assembled, so that it
+ * can be handed to the terminal with a single `write()`.
+ * Holds `.data`, `.length` and `.capacity`.
+ */
+typedef struct wi_frame_buffer wi_frame_buffer;
+
+/*
+ * Worker-threads that run a function over a batch of items, together with
+ * the thread that hands out the batch. See `run_in_thread_pool()`.
+ */
+typedef struct wi_thread_pool wi_thread_pool;
+
+/*
+ * One cell of the screen-model used when diffing frames: the bytes of the
+ * glyph that's in it and the index of the interned style it is drawn with.
+ */
+typedef struct wi_cell wi_cell;
+
+/*
+ * The markup the terminal draws text in, as SGR-sequences leave it: the
+ * effects that are on and both colours.
+ */
+typedef struct wi_style wi_style;
+
+/*
+ * An SGR-sequence that takes the terminal from one interned style to
+ * another, remembered so it doesn't have to be worked out every frame.
+ */
+typedef struct wi_style_step wi_style_step;
+
+/*
+ * A model of what is on the terminal, in cells. Holds a `front` grid with
+ * what the terminal currently shows, a `back` grid with the new frame,
+ * and a table of interned styles (the markup active on a cell).
+ */
+typedef struct wi_screen wi_screen;
+
 /*
  * One keymap, containing a key in 'a-z' range, a wi_modifier, and a
  * callback function that gets executed when the key is pressed.
  */
 typedef struct wi_keymap wi_keymap;
 
+/*
+ * The keymaps of a session compiled into a lookup-table, indexed by the
+ * byte that the terminal sends and whether ALT was held. Never changed
+ * after being built, a new table replaces it instead.
+ */
+typedef struct wi_keymap_table wi_keymap_table;
+
 /* A simple struct with .row and .col */
 typedef struct wi_position wi_position;
 
+/*
+ * Counters and timings of a shown session, only kept up to date when
+ * `.collect_stats` of the session is set. Read it with `wi_get_stats()`.
+ * Holds frame-, byte- and window-counts, time spent per phase of a frame,
+ * and the latency between a keypress and the frame that follows it.
+ */
+typedef struct wi_stats wi_stats;
+
 /*
  * A container for wi_window's. Holds a 2D array of windows, whether to clear
- * the screen before rendering, which window is focussed, a list of wi_keymap's,
- * 2 atomic-bools keep_running and need_rerender.
+ * the screen before rendering, which window is focussed, a list of wi_keymap's
+ * and whether it keeps running.
  * Holds an aditional internal struct for bookkeeping.
  */
 typedef struct wi_session wi_session;
@@ -142,9 +247,216 @@ struct wi_string {
 };
 
 struct wi_content {
+	/* Until `.fully_split`, `.original.length` and `.amount_lines` only cover
+	 * the part that was split into lines so far, so there are at least
+	 * `.amount_lines` lines */
 	wi_string_view original;
 	wi_string_view* line_list;
 	int amount_lines;
+	int line_list_capacity;
+	bool fully_split;
+
+	/* (HEAP) Shared between copies of the content, NULL when not split */
+	wi_column_index* column_index;
+
+	/* The width wrapped content is wrapped for, 0 when it isn't wrapped */
+	int wrap_width;
+	/* (HEAP) When rewrapping started somewhere in the middle, the lines
+	 * before `.line_list` that still have to be put in front of it.
+	 * Until then the line-numbers are relative to where it started.
+	 * NULL when there are none */
+	wi_wrap_prefix* prefix;
+	/* (HEAP) NULL until it's rewrapped for another width */
+	wi_wrap_cache* wrap_cache;
+
+	/* Size of the mapping `.original` lies in when it was added with
+	 * `wi_add_file_content_to_window()`, 0 otherwise */
+	size_t mapped_size;
+	/* Capacity and length of `.original` when the library allocated it for
+	 * `wi_append_content()`, 0 otherwise */
+	size_t appendable_capacity;
+	size_t appendable_length;
+	/* (HEAP) Where `.original` and `.line_list` live when the content is
+	 * bounded, which then never gets wrapped. NULL otherwise */
+	wi_ring* ring;
+};
+
+struct wi_wrap_prefix {
+	int end;
+	int bytes;
+	/* (HEAP) */
+	wi_string_view* lines;
+	int amount_lines;
+	int capacity;
+};
+
+/* Widths a `wi_wrap_cache` remembers at most */
+#define WI_WRAP_CACHE_ENTRIES 4
+
+struct wi_wrap_cache {
+	/* Without `.wrap_cache` themselves */
+	wi_content entries[WI_WRAP_CACHE_ENTRIES];
+	int amount_entries;
+};
+
+struct wi_ring {
+	/* Both mapped twice, `.text_size` bytes and `.line_capacity` lines */
+	char* text;
+	size_t text_size;
+	wi_string_view* lines;
+	int line_capacity;
+
+	/* Lines and bytes kept at most, older ones are evicted */
+	int max_lines;
+	int max_bytes;
+};
+
+struct wi_column_checkpoint {
+	unsigned int bytes;
+	unsigned int width;
+};
+
+struct wi_style_span {
+	unsigned int bytes;
+	unsigned int width;
+	unsigned int length;
+	/* It starts by resetting all markup, so nothing before it matters */
+	bool resets;
+};
+
+struct wi_carried_style {
+	/* Whether it is found out yet */
+	bool known;
+	/* Line and span replaying starts at, -1 when no markup carries over */
+	int line;
+	int span;
+	/* Last line before it with markup, where replaying ends */
+	int last_line;
+	/* Next line after it with markup, -1 until one is found */
+	int next_line;
+};
+
+struct wi_line_index {
+	/* (HEAP) NULL until the line is scrolled far enough horizontally.
+	 * Checkpoint `i` lies at column `i * WI_COLUMN_CHECKPOINT_INTERVAL` */
+	wi_column_checkpoint* checkpoints;
+	int amount_checkpoints;
+
+	/* (HEAP) In the order they appear, -1 spans until they are needed.
+	 * Lines without escape-sequences never get them. */
+	wi_style_span* spans;
+	int amount_spans;
+
+	/* Only for wrapped content */
+	wi_carried_style carried;
+};
+
+struct wi_column_index {
+	/* (HEAP) Per line */
+	wi_line_index* lines;
+	/* Lines there is room for in the array above, from `.first_line` on */
+	int amount_lines;
+	/* Line 0 lies this far into the array, after lines were evicted */
+	int first_line;
+};
+
+struct wi_frame_buffer {
+	/* (HEAP) */
+	char* data;
+	size_t length;
+	size_t capacity;
+};
+
+struct wi_thread_pool {
+	/* (HEAP) */
+	thrd_t* threads;
+	int amount_threads;
+
+	/* Guards everything below */
+	mtx_t lock;
+	cnd_t work_available;
+	cnd_t work_finished;
+	bool stopping;
+
+	/* The current batch, `.function` gets called on each of the items */
+	void (*function)(void*);
+	void** items;
+	int amount_items;
+	int next_item;
+	int unfinished_items;
+};
+
+struct wi_cell {
+	char glyph[8];			/* UTF-8 bytes, not '\0'-terminated, including
+							 * the combining characters that follow */
+	unsigned char bytes;	/* Amount of bytes in use in .glyph, 0 for the
+							 * second cell of a wide character */
+	unsigned short style;	/* Index in wi_screen.styles */
+};
+
+struct wi_style {
+	/* Bit `n` is set when SGR-parameter `n` (1 to 9, except 4) is in effect */
+	unsigned short effects;
+	/* 0 for none, 1 for "4", 2 for "21", 3 to 5 for "4:3" to "4:5" */
+	unsigned char underline;
+	/* 0 for the default colour, otherwise one of the WI_COLOUR_* kinds
+	 * in the top byte and the colour itself in the bytes below */
+	unsigned int foreground;
+	unsigned int background;
+	/* Index in wi_screen.extras of the parameters that are none of the
+	 * above, 0 for none */
+	unsigned short extra;
+};
+
+/* Longest SGR-sequence a `wi_style_step` holds */
+#define WI_STYLE_STEP_BYTES 27
+
+struct wi_style_step {
+	unsigned short from;
+	unsigned short to;
+	/* 0 for a step that is not in use */
+	unsigned char length;
+	char sequence[WI_STYLE_STEP_BYTES];
+};
+
+/* Steps a `wi_screen` remembers of each kind */
+#define WI_STYLE_STEPS 256
+
+/* Styles a `wi_screen` interns at most, markup past that is left alone */
+#define WI_SCREEN_MAX_STYLES 4096
+
+/* Slots of the hash-table styles are looked up in, twice the styles */
+#define WI_STYLE_SLOTS (2 * WI_SCREEN_MAX_STYLES)
+
+struct wi_screen {
+	/* (HEAP) rows * cols cells each */
+	wi_cell* front;
+	wi_cell* back;
+	int rows;
+	int cols;
+
+	/* Whether .front matches what the terminal is showing */
+	bool valid;
+
+	/* (HEAP) Style 0 is always the default style */
+	wi_style* styles;
+	int amount_styles;
+	int styles_capacity;
+	/* Index + 1 of the style hashed to each slot (or the next free one),
+	 * 0 for an empty slot */
+	unsigned short style_slots[WI_STYLE_SLOTS];
+
+	/* (HEAP) SGR-parameters, separated by ';', that a style can't tell
+	 * apart itself. Extra 0 is always "" */
+	char** extras;
+	int amount_extras;
+	int extras_capacity;
+
+	/* Where sequences from the frame took the style (looked up by `.from`
+	 * and `.sequence`), and the sequences written to change the style
+	 * (looked up by `.from` and `.to`) */
+	wi_style_step applied[WI_STYLE_STEPS];
+	wi_style_step changes[WI_STYLE_STEPS];
 };
 
 struct wi_keymap {
@@ -153,11 +465,47 @@ struct wi_keymap {
 	void (*callback)(const char, wi_session*);
 };
 
+/* One slot per byte, for without and with ALT */
+#define WI_KEYMAP_TABLE_SLOTS (2 * 256)
+
+struct wi_keymap_table {
+	/* Replaced tables that might still be in use by the input-thread */
+	wi_keymap_table* retired_next;
+
+	/* The callbacks of slot `i` are `callbacks[start[i]]` up to (excluding)
+	 * `callbacks[start[i + 1]]`, in the order they were added */
+	int start[WI_KEYMAP_TABLE_SLOTS + 1];
+	void (*callbacks[])(const char, wi_session*);
+};
+
 struct wi_position {
 	int row;
 	int col;
 };
 
+struct wi_stats {
+	/* Frames written, and frames where no window had changed */
+	unsigned long frames_rendered;
+	unsigned long frames_skipped;
+	/* Bytes written to the terminal */
+	unsigned long long bytes_written;
+	unsigned long windows_redrawn;
+
+	/* Total time spent, in nanoseconds */
+	long long dimension_ns;			/* Calculating window-sizes, on resize
+									 * this includes re-wrapping content */
+	long long update_content_ns;	/* `wi_update_content()` */
+	long long render_ns;			/* Building frames */
+	long long write_ns;				/* Writing frames to the terminal */
+
+	/* Time from a keypress until the next frame was written, in nanoseconds.
+	 * Keypresses that come in before that frame share one sample. */
+	unsigned long latency_samples;
+	long long last_latency_ns;
+	long long max_latency_ns;
+	long long total_latency_ns;
+};
+
 struct wi_session {
 	/* (HEAP) */
 	wi_window*** windows;
@@ -165,7 +513,24 @@ struct wi_session {
 	wi_position focus_pos;
 	wi_keymap* keymaps;
 
+	/* Only send the cells that changed since the previous frame */
+	bool diff_rendering;
+	/* The terminal supports left and right margins (DECSLRM), so that
+	 * .diff_rendering can also scroll windows that have others next to them */
+	bool scroll_margins;
+	/* Maximum frames per second, 0 for no limit */
+	int max_frame_rate;
+	/* Keep the counters of `wi_get_stats()` up to date */
+	bool collect_stats;
+	/* Bytes each wrapped content may keep for earlier widths, 0 for none */
+	size_t wrap_cache_size;
+	/* Threads (counting the render-thread) that rewrap windows after a
+	 * resize, or wrap content while idle. 0 for one per processor */
+	int wrap_threads;
+
 	bool keep_running;
+	/* Only set by the library, call `wi_mark_window_dirty()` to get a new
+	 * frame after changing a window */
 	atomic_bool need_rerender;
 	bool running_render_thread;
 
@@ -178,6 +543,50 @@ struct wi_session {
 		int* capacity_cols;
 
 		int keymap_array_size;
+		/* (HEAP) What the input-thread looks keypresses up in */
+		_Atomic(wi_keymap_table*) keymap_table;
+		wi_keymap_table* retired_keymap_tables;
+
+		/* Every frame is built up in here before being written out */
+		wi_frame_buffer frame;
+
+		/* What is on the terminal, used with .diff_rendering. Its styles
+		 * are used to compact the markup of every frame */
+		wi_screen screen;
+		/* A frame with compacted markup is written in here, then swapped
+		 * with .frame */
+		wi_frame_buffer compacted_frame;
+
+		/* Writing a byte in [1] wakes up the render-thread blocking on [0].
+		 * Only open while the session is shown, -1 otherwise. */
+		int render_wake_pipe[2];
+		/* Same, but for the input-thread */
+		int input_wake_pipe[2];
+
+		/* Set by the SIGWINCH-handler, the terminal only gets asked for its
+		 * size again when this is true */
+		atomic_bool resize_pending;
+		/* Terminal-size the window-dimensions were last calculated for */
+		int terminal_rows;
+		int terminal_cols;
+
+		/* Windows drawn by the last call to `render_session()` */
+		int frame_windows_redrawn;
+
+		/* (HEAP) Helps the render-thread out while the session is shown,
+		 * NULL otherwise or with only 1 of `.wrap_threads` */
+		wi_thread_pool* wrap_pool;
+
+		/* Held while reading or changing content, which both the render-
+		 * and input-thread do. Recursive. */
+		mtx_t content_lock;
+
+		/* Guarded by stats_lock, because it's read from other threads */
+		wi_stats stats;
+		mtx_t stats_lock;
+		/* When the oldest keypress not yet followed by a frame came in,
+		 * 0 when there is none */
+		_Atomic(long long) pending_keypress_ns;
 	} internal;
 };
 
@@ -190,6 +599,11 @@ struct wi_window {
 	wi_border border;
 
 	bool wrap_text;
+	/* Only split content into lines as far as it is shown (non-wrapping) */
+	bool lazy_content;
+	/* Move the cursor to the last line when content gets added or appended
+	 * while it is there, so the window keeps showing the end */
+	bool follow_tail;
 
 	wi_cursor_rendering cursor_rendering;
 
@@ -214,6 +628,17 @@ struct wi_window {
 		wi_position offset_cursor;	/* In visual chars */
 
 		bool currently_focussed;
+
+		/* The session this window was added to, NULL when not added */
+		wi_session* session;
+
+		/* Whether the window changed since it was last rendered */
+		atomic_bool dirty;
+		/* The content-string that was shown when last rendered */
+		const char* rendered_content;
+		/* Whether the cursor has to go to the last line when rendered next,
+		 * see `follow_tail` */
+		bool follow_pending;
 	} internal;
 };
 
@@ -27,6 +27,8 @@
  * 		- contents - empty
  * 		- border - empty title and footer, rounded borders
  * 		- wrap_text = false
+ * 		- lazy_content = false
+ * 		- follow_tail = false
  * 		- depending_windows = NULL
  *
  * See the library README.md for more details.
@@ -40,6 +42,12 @@ wi_window* wi_make_window(void);
  * Sets the following defaults:
  *		- windows - empty
  *		- start_clear_screen = false
+ *		- diff_rendering = false
+ *		- scroll_margins = false
+ *		- max_frame_rate = 0 (no limit)
+ *		- collect_stats = false
+ *		- wrap_cache_size = 1 MiB
+ *		- wrap_threads = 1
  *		- focus_pos = { 0, 0 }
  *		- keybinds - empty
  *
@@ -95,9 +103,56 @@ void wi_bind_dependency(wi_window* parent, wi_window* depending);
  */
 wi_window* wi_add_content_to_window(wi_window*, char* content, const wi_position);
 
+/*
+ * Add the contents of a file to an existing window at the given position,
+ * like `wi_add_content_to_window()`.
+ * The file gets mapped into memory read-only instead of read, so only the
+ * parts that are split or shown have to be loaded. Combined with
+ * `.lazy_content` this makes huge files cheap to show.
+ * The mapping is removed again by `wi_free_window()`. Changes to the file
+ * while it is shown are not picked up.
+ *
+ * @returns: updated window, or NULL when the file could not be mapped (see
+ *			 errno). Files of 2 GiB or more can't be shown (EFBIG).
+ */
+wi_window* wi_add_file_content_to_window(
+	wi_window*, const char* path, const wi_position
+);
+
+/*
+ * Add empty content with a fixed size to an existing window at the given
+ * position, to be filled with `wi_append_content()`.
+ * Only the last `max_lines` lines (0 for no limit) and `max_bytes` bytes are
+ * kept, older ones are dropped as new text comes in, so the memory it takes
+ * stays the same. The line still being written doesn't count as a line.
+ * Bounded content is never wrapped, so the window mustn't wrap text.
+ *
+ * @returns: updated window, NULL (with errno set) when its buffers can't be
+ * made, or EINVAL when the window wraps text
+ */
+wi_window* wi_add_bounded_content_to_window(
+	wi_window*, const int max_lines, const size_t max_bytes, const wi_position
+);
+
+/*
+ * Append text to the content at the given position, or add it as new
+ * content when there is none.
+ * Only the last line and the new text have to be split (or wrapped) again,
+ * so this is made to be called often, like when following a log. Frames
+ * asked for by appends that come in quickly get bundled into one.
+ * The first append copies the content into a buffer of the library, the
+ * string given to `wi_add_content_to_window()` isn't used after that.
+ *
+ * @returns: updated window
+ */
+wi_window* wi_append_content(wi_window*, const char* text, const wi_position);
+
 /*
  * Add a new keymap to the session.
  * This function handles resource allocation for you.
+ * Keymaps can also be added, removed and updated while the session is
+ * shown (for example from inside another keymap), and take effect on the
+ * next keypress.
  *
  * @returns: the session with the update keymap
  */
@@ -141,11 +196,35 @@ wi_session* wi_update_keymap_from_session(
 
 /*
  * Print out one frame.
+ * Only the windows that changed since they were last rendered are drawn,
+ * so the cursor should be at the top-left of the previously printed frame.
+ * All windows start out as changed, so the first frame is always complete.
  *
  * @returns: height of printed frame.
  */
 int wi_render_frame(wi_session*);
 
+/*
+ * Render one frame into memory instead of to the terminal, as if the
+ * terminal had `rows` rows and `cols` columns. This makes it possible to
+ * test and benchmark rendering without a terminal.
+ * The bytes are the same as would be written to the terminal by
+ * `wi_render_frame()`, or through the screen-model when `.diff_rendering`
+ * is set, with the cursor starting at the top-left of the frame.
+ * Like `wi_render_frame()`, only changed windows are drawn, unless the
+ * size changed since the previous frame.
+ *
+ * At most `buffer_size - 1` bytes are copied into `buffer`, followed by a
+ * '\0'. The frame is consumed even when it did not fit.
+ * Do not call this on a session that is being shown.
+ *
+ * @returns: amount of bytes in the whole frame
+ */
+size_t wi_render_frame_to_buffer(
+	wi_session*, const int rows, const int cols,
+	char* buffer, const size_t buffer_size
+);
+
 /*
  * Render a session to the screen, and take in user input.
  * Quits when `wi_quit_rendering()` is called on this session.
@@ -263,6 +342,8 @@ wi_content wi_get_current_window_content(const wi_window* window);
  * The actual cursor-position is split over 2 internal variables, and can be
  * out of bounds (details...), so this is a utility function to easily get
  * what you want.
+ * Right after a wrapped window is resized, the lines before where it started
+ * rewrapping are counted (not wrapped), which reads through all of them.
  */
 wi_position wi_get_window_cursor_pos(const wi_window* window);
 
@@ -320,7 +401,32 @@ wi_window* wi_get_focussed_window(wi_session*);
  * Call this function when the contents were updated.
  * This will re-split on '\n' for non-wrapped lines, and recalculate for
  * wrapped lines.
+ * The window gets marked as changed, so it is redrawn in the next frame.
  */
 wi_window* wi_update_content(wi_window*);
 
+/*
+ * Call this function after changing something of a window that isn't its
+ * content, like the title or footer of its border.
+ * The window gets redrawn in the next frame, and a shown session that is
+ * sleeping gets woken up for it. Safe to call from any thread.
+ *
+ * @returns: the window itself
+ */
+wi_window* wi_mark_window_dirty(wi_window*);
+
+/*
+ * Get a copy of the statistics of the session, safe to call while the
+ * session is shown (for example from a keymap).
+ * Only counts while `.collect_stats` of the session is true.
+ *
+ * @returns: snapshot of the statistics
+ */
+wi_stats wi_get_stats(wi_session*);
+
+/*
+ * Set all statistics of the session back to 0.
+ */
+void wi_reset_stats(wi_session*);
+
 #endif /* !WI_TUI_FUNCTIONS_HEADER_GUARD */
@@ -8,6 +8,33 @@ void raw_terminal(void);
 int input_function(void* args);
 int render_function(void* args);
 
+/*
+ * Wake up the render-thread without asking for a new frame.
+ * Safe to call from a signal-handler.
+ */
+void wake_render_thread(wi_session*);
+
+/*
+ * Rebuild the lookup-table of the keymaps of the session, and swap it in
+ * for the input-thread. Call this after every change to `.keymaps`.
+ */
+void compile_keymaps(wi_session*);
+
+/*
+ * Wake up the input-thread, so it notices the session stopped running.
+ * Safe to call from a signal-handler.
+ */
+void wake_input_thread(wi_session*);
+
+/*
+ * Ask the render-thread for a new frame, and wake it up.
+ * Safe to call from a signal-handler.
+ */
+void request_rerender(wi_session*);
+
+/* Current time in nanoseconds, on a clock that doesn't jump around */
+long long monotonic_ns(void);
+
 /* utility-functions, I didn't want to make an extra headerfile for this */
 
 /*
@@ -20,11 +47,177 @@ int render_function(void* args);
  */
 wi_content split_lines(char*);
 
+/*
+ * Prepare content to be split into lines later on, with
+ * `continue_split_lines()`. Nothing is split yet.
+ */
+wi_content lazy_split_lines(char*);
+
+/*
+ * Split (or wrap, for wrapped content) more of lazily split content, until there are at least
+ * `until_lines` lines, `max_bytes` more bytes are split, or everything is.
+ */
+void continue_split_lines(
+	wi_content*, const int until_lines, const int max_bytes
+);
+
 /*
  * Does the same as `split_lines()`, but wraps where needed.
  */
 wi_content split_lines_wrapped(char*, int cols);
 
+/*
+ * Prepare content to be wrapped later on, with `continue_split_lines()`,
+ * starting at byte `from`, which has to be the start of a line.
+ * When that isn't 0, the lines before it are wrapped into a prefix with
+ * `continue_wrap_prefix()`. Nothing is wrapped yet.
+ */
+wi_content lazy_wrap_lines(char*, const int cols, const int from);
+
+/*
+ * Wrap `max_bytes` more of the prefix of wrapped content.
+ *
+ * @returns: whether the prefix is fully wrapped
+ */
+bool continue_wrap_prefix(wi_content*, const int max_bytes);
+
+/*
+ * Count the lines the prefix of wrapped content takes once it's fully
+ * wrapped, without wrapping (or keeping) the part that isn't yet.
+ */
+int count_wrap_prefix_lines(const wi_content*);
+
+/*
+ * Put a fully wrapped prefix in front of the lines of the content.
+ *
+ * @returns: the amount of lines that were put in front
+ */
+int merge_wrap_prefix(wi_content*);
+
+/*
+ * Append `length` bytes of text to content, copying it into a buffer of the
+ * library first if needed. What was split or wrapped stays, except for the
+ * last line, which continues with the new text.
+ * Bounded content gets split right away, evicting the oldest lines that
+ * don't fit anymore.
+ *
+ * @returns: the amount of lines evicted from the front
+ */
+int append_to_content(wi_content*, const char* text, const size_t length);
+
+/*
+ * Map the buffers for bounded content, `max_lines` 0 means it's only
+ * bounded by bytes.
+ *
+ * @returns: the ring, NULL on failure (errno is set)
+ */
+wi_ring* make_ring(const int max_lines, const int max_bytes);
+
+/* Unmap the buffers of a ring and free it, NULL is allowed */
+void free_ring(wi_ring*);
+
+/* Empty content that lives in the buffers of a ring */
+wi_content bounded_content(wi_ring*);
+
+/* Columns between two checkpoints in a `wi_column_index` */
+#define WI_COLUMN_CHECKPOINT_INTERVAL 64
+
+/*
+ * Find the last checkpoint at or before visual column `column` of a line,
+ * building the checkpoints of that line when they don't exist yet.
+ * Walking the line from there gives the same result as walking it from the
+ * start, as long as the style-spans before it are replayed.
+ *
+ * @returns: the checkpoint
+ */
+wi_column_checkpoint find_column_checkpoint(
+	const wi_content*, const int line, const int column
+);
+
+/*
+ * Find the escape-sequences of a line, tokenizing the line the first time
+ * they are needed. Lines without any are not kept track of.
+ *
+ * @returns: the spans, NULL when there are none (`amount_spans` is set)
+ */
+const wi_style_span* find_style_spans(
+	const wi_content*, const int line, int* amount_spans
+);
+
+/*
+ * Find the markup a wrapped line goes on in, working it out once for the
+ * lines before it that weren't yet.
+ * The lines with markup from `.line` on follow each other by their
+ * `.next_line`, up to `.last_line`.
+ *
+ * @returns: where replaying starts, `.line` is -1 when nothing carries over
+ */
+wi_carried_style find_carried_style(const wi_content*, const int line);
+
+/* Free a column-index, along with the checkpoints and spans of its lines */
+void free_column_index(wi_column_index*);
+
+/*
+ * The content currently shown by the window, in the content-grid itself
+ * instead of a copy like `wi_get_current_window_content()`.
+ */
+wi_content* current_window_content(const wi_window*);
+
+/*
+ * Make sure the current content of the window has at least `amount_lines`
+ * lines split, when it has that many.
+ */
+void split_window_lines(const wi_window*, const int amount_lines);
+
+/*
+ * Wrap `max_bytes` more of the prefix of some content of the window, when it
+ * has one. Once it's done, it's put in front of the other lines, and the
+ * cursor is moved along when it's the current content.
+ */
+void wrap_window_prefix(wi_window*, wi_content*, const int max_bytes);
+
+/*
+ * Rewrap the content of a wrapping window for its new rendered width, using
+ * the lines wrapped for that width before when they are still cached.
+ * Unlike `wi_update_content()`, the content itself has to be unchanged.
+ * The content-lock has to be held, but only this window gets touched, so
+ * several windows can be rewrapped at the same time.
+ */
+void resize_window_content(wi_window*);
+
+/*
+ * Start a pool of `amount_threads` worker-threads.
+ *
+ * @returns: the pool, NULL when `amount_threads` is 0 or less
+ */
+wi_thread_pool* make_thread_pool(const int amount_threads);
+
+/* Stop the threads of a pool and free it, NULL is allowed */
+void free_thread_pool(wi_thread_pool*);
+
+/*
+ * Call `function` on every item, spread over the threads of the pool and the
+ * calling thread. Returns once every call is done.
+ * Runs everything on the calling thread when the pool is NULL.
+ */
+void run_in_thread_pool(
+	wi_thread_pool*, void (*function)(void*), void** items, const int amount_items
+);
+
+/*
+ * Widths of all Unicode characters, generated by tools/width_table.py.
+ * `width_table_blocks` gives the block of 256 characters a character lies
+ * in, `width_table_widths` the widths in that block, 2 bits per character
+ * starting at the lowest bits.
+ */
+#define WI_WIDTH_BLOCK_BYTES 64
+extern const unsigned char width_table_blocks[0x110000 >> 8];
+extern const unsigned char width_table_widths[][WI_WIDTH_BLOCK_BYTES];
+
+/* Lock/unlock the content-lock of a session, NULL is allowed */
+void lock_content(wi_session*);
+void unlock_content(wi_session*);
+
 /* Decrement index-pointer when on continuation byte until not anymore */
 void skip_continuation_bytes_left(int*, const char*);
 
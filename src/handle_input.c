@@ -1,6 +1,8 @@
-#include <stdatomic.h>	/* atomic_store() */
-#include <threads.h>	/* thrd_sleep() */
-#include <unistd.h>		/* read(), ICANON, ECHO, ... */
+#include <limits.h>		/* INT_MAX */
+#include <poll.h>		/* poll(), struct pollfd */
+#include <stdatomic.h>	/* atomic_store(), atomic_exchange() */
+#include <string.h>		/* memmove() */
+#include <unistd.h>		/* read(), write(), ICANON, ECHO, ... */
 #include <termios.h>	/* tcgetattr(), tcsetattr() */
 #include <fcntl.h>		/* fcntl(), F_GETFLS, O_NONBLOCK */
 #include <errno.h>		/* errno, EAGAIN, EWOULDBLOCK */
@@ -14,8 +16,9 @@
 struct termios old_terminal_settings;
 
 void raw_terminal(void) {
-	/* Hide cursor */
+	/* Hide cursor, flushed now because frames bypass stdio */
 	printf("\033[?25l");
+	fflush(stdout);
 
 	old_terminal_settings = (struct termios) {0};
 	/* Save old settings */
@@ -47,6 +50,7 @@ void raw_terminal(void) {
 void restore_terminal(void) {
 	/* Bring back cursor */
 	printf("\033[?25h");
+	fflush(stdout);
 
 	/* Set back to normal mode */
 	wiAssert(
@@ -106,26 +110,51 @@ char convert_key(wi_keymap keymap) {
 	return -2; /* IMPORTANT: this needs to be != -1 */
 }
 
+/*
+ * Mark a window as changed, so that the render-thread redraws it, and let
+ * the render-thread know there is something to redraw.
+ */
+static void mark_dirty(wi_session* session, wi_window* window) {
+	atomic_store(&(window->internal.dirty), true);
+	request_rerender(session);
+}
+
 /*
  * All the scroll-functions first check if we can just move the visual cursor,
  * and if that's not possible, see if we can move the offset (which will
  * actually scroll the text).
+ * The keymap-functions hold the content-lock while the static versions do
+ * the work, so the render-thread doesn't change content underneath them.
  */
 
-void wi_scroll_up(const char _, wi_session* session) {
-	WI_UNUSED(_);
+static void scroll_up(wi_session* session) {
 	wi_window* focussed_window = wi_get_focussed_window(session);
+	if (
+		focussed_window->internal.visual_cursor.row == 0
+		&& focussed_window->internal.offset_cursor.row == 0
+	) {
+		/* The lines before the ones rewrapped first could still be missing */
+		wrap_window_prefix(
+			focussed_window, current_window_content(focussed_window), INT_MAX
+		);
+	}
 	if (focussed_window->internal.visual_cursor.row > 0) {
 		focussed_window->internal.visual_cursor.row--;
-		atomic_store(&(session->need_rerender), true);
+		mark_dirty(session, focussed_window);
 	} else if (focussed_window->internal.offset_cursor.row > 0) {
 		focussed_window->internal.offset_cursor.row--;
-		atomic_store(&(session->need_rerender), true);
+		mark_dirty(session, focussed_window);
 	}
 }
 
-void wi_scroll_down(const char _, wi_session* session) {
+void wi_scroll_up(const char _, wi_session* session) {
 	WI_UNUSED(_);
+	lock_content(session);
+	scroll_up(session);
+	unlock_content(session);
+}
+
+static void scroll_down(wi_session* session) {
 	wi_window* focussed_window = wi_get_focussed_window(session);
 
 	/* Aliasses for these loooooong names */
@@ -133,6 +162,9 @@ void wi_scroll_down(const char _, wi_session* session) {
 	int* offset_row = &focussed_window->internal.offset_cursor.row;
 
 	const int fw_height = focussed_window->internal.rendered_height;
+
+	/* Lazily split content only needs to be known up to one page further */
+	split_window_lines(focussed_window, *offset_row + fw_height + 1);
 	const int fw_amount_content_lines =
 		wi_get_current_window_content(focussed_window).amount_lines;
 
@@ -143,15 +175,21 @@ void wi_scroll_down(const char _, wi_session* session) {
 
 	if (*visual_row + 1 < fw_height) {
 		(*visual_row)++;
-		atomic_store(&(session->need_rerender), true);
+		mark_dirty(session, focussed_window);
 	} else if (*offset_row + fw_height < fw_amount_content_lines) {
 		(*offset_row)++;
-		atomic_store(&(session->need_rerender), true);
+		mark_dirty(session, focussed_window);
 	}
 }
 
-void wi_scroll_left(const char _, wi_session* session) {
+void wi_scroll_down(const char _, wi_session* session) {
 	WI_UNUSED(_);
+	lock_content(session);
+	scroll_down(session);
+	unlock_content(session);
+}
+
+static void scroll_left(wi_session* session) {
 	wi_window* focussed_window = wi_get_focussed_window(session);
 
 	if (
@@ -175,25 +213,31 @@ void wi_scroll_left(const char _, wi_session* session) {
 	if (*offset_c_col >= line_length_c) {
 		*offset_c_col = line_length_c - 1;
 		*visual_col = 0;
-		atomic_store(&(session->need_rerender), true);
+		mark_dirty(session, focussed_window);
 	} else if (*offset_c_col + *visual_col >= line_length_c) {
 		*visual_col = line_length_c - *offset_c_col - 1;
-		atomic_store(&(session->need_rerender), true);
+		mark_dirty(session, focussed_window);
 	}
 
 
 	if (!cursor_linebased && *visual_col > 0) {
 		(*visual_col)--;
-		atomic_store(&(session->need_rerender), true);
+		mark_dirty(session, focussed_window);
 	} else if (*offset_c_col > 0) {
 		/* Move to actual start of codepoint instead of byte in the middle */
 		(*offset_c_col)--;
-		atomic_store(&(session->need_rerender), true);
+		mark_dirty(session, focussed_window);
 	}
 }
 
-void wi_scroll_right(const char _, wi_session* session) {
+void wi_scroll_left(const char _, wi_session* session) {
 	WI_UNUSED(_);
+	lock_content(session);
+	scroll_left(session);
+	unlock_content(session);
+}
+
+static void scroll_right(wi_session* session) {
 	wi_window* focussed_window = wi_get_focussed_window(session);
 
 	if (focussed_window->wrap_text && focussed_window->cursor_rendering == LINEBASED) {
@@ -218,10 +262,10 @@ void wi_scroll_right(const char _, wi_session* session) {
 	if (*offset_c_col >= line_length_c) {
 		*offset_c_col = line_length_c - 1;
 		*visual_col = 0;
-		atomic_store(&(session->need_rerender), true);
+		mark_dirty(session, focussed_window);
 	} else if (*offset_c_col + *visual_col >= line_length_c) {
 		*visual_col = line_length_c - *offset_c_col - 1;
-		atomic_store(&(session->need_rerender), true);
+		mark_dirty(session, focussed_window);
 	}
 
 	if (
@@ -230,33 +274,41 @@ void wi_scroll_right(const char _, wi_session* session) {
 		&& *visual_col + *offset_c_col + 1 < line_length_c
 	) {
 		(*visual_col)++;
-		atomic_store(&(session->need_rerender), true);
+		mark_dirty(session, focussed_window);
 	} else if (*offset_c_col + fw_width < line_length_c) {
 		(*offset_c_col)++;
-		atomic_store(&(session->need_rerender), true);
+		mark_dirty(session, focussed_window);
 	}
 }
 
-void un_focus(wi_session* session) {
-	int cursor_row = session->focus_pos.row;
-	int cursor_col = session->focus_pos.col;
-	if (cursor_col >= session->internal.amount_cols[cursor_row]) {
-		cursor_col = session->internal.amount_cols[cursor_row] - 1;
+void wi_scroll_right(const char _, wi_session* session) {
+	WI_UNUSED(_);
+	lock_content(session);
+	scroll_right(session);
+	unlock_content(session);
+}
+
+/*
+ * Set whether the focussed window is in focus, and mark it as changed.
+ * The window it depends on shows its cursor while one of its depending
+ * windows is in focus, so that one changed as well.
+ */
+void set_focus(wi_session* session, const bool focussed) {
+	wi_window* window = wi_get_focussed_window(session);
+	window->internal.currently_focussed = focussed;
+
+	mark_dirty(session, window);
+	if (window->depends_on != NULL) {
+		mark_dirty(session, window->depends_on);
 	}
+}
 
-	session->windows[cursor_row][cursor_col]
-		->internal.currently_focussed = false;
+void un_focus(wi_session* session) {
+	set_focus(session, false);
 }
 
 void focus(wi_session* session) {
-	int cursor_row = session->focus_pos.row;
-	int cursor_col = session->focus_pos.col;
-	if (cursor_col >= session->internal.amount_cols[cursor_row]) {
-		cursor_col = session->internal.amount_cols[cursor_row] - 1;
-	}
-
-	session->windows[cursor_row][cursor_col]
-		->internal.currently_focussed = true;
+	set_focus(session, true);
 }
 
 /*
@@ -277,7 +329,6 @@ void wi_move_focus_up(const char _, wi_session* session) {
 		un_focus(session);
 		session->focus_pos.row--;
 		focus(session);
-		atomic_store(&(session->need_rerender), true);
 	}
 }
 
@@ -287,7 +338,6 @@ void wi_move_focus_down(const char _, wi_session* session) {
 		un_focus(session);
 		session->focus_pos.row++;
 		focus(session);
-		atomic_store(&(session->need_rerender), true);
 	}
 }
 
@@ -298,7 +348,6 @@ void wi_move_focus_left(const char _, wi_session* session) {
 		un_focus(session);
 		session->focus_pos.col--;
 		focus(session);
-		atomic_store(&(session->need_rerender), true);
 	}
 }
 
@@ -311,51 +360,236 @@ void wi_move_focus_right(const char _, wi_session* session) {
 		un_focus(session);
 		session->focus_pos.col++;
 		focus(session);
-		atomic_store(&(session->need_rerender), true);
 	}
 }
 
 
+void wake_input_thread(wi_session* session) {
+	const int fd = session->internal.input_wake_pipe[1];
+	if (fd >= 0) {
+		/* When the pipe is full, a wake-up is pending anyway */
+		ssize_t _ = write(fd, "", 1);
+		WI_UNUSED(_);
+	}
+}
+
+/* How long to wait for the rest of an escape-sequence before treating the
+ * '\033' as a press on the escape-key */
+#define WI_ESCAPE_TIMEOUT_MS 25
+
+/* One decoded keypress, sequences like arrow-keys are not supported (yet) */
+typedef struct key_event {
+	char key;
+	bool alt;
+	bool supported;
+} key_event;
+
+/*
+ * Decode one keypress from the start of `buffer`.
+ * When the buffer ends in the middle of an escape-sequence, nothing is
+ * decoded, unless `flush` is true, then what is there gets decoded as-is.
+ *
+ * @returns: amount of bytes used, 0 when the keypress is incomplete
+ */
+int decode_key(
+	const char* buffer, const int length, const bool flush, key_event* event
+) {
+	*event = (key_event) { .key = buffer[0], .alt = false, .supported = true };
+
+	if (buffer[0] != '\033') {
+		return 1;
+	}
+	if (length == 1) {
+		/* Escape on its own, or the start of a sequence that isn't in yet */
+		return flush ? 1 : 0;
+	}
+
+	if (buffer[1] == '[') {
+		/* Control Sequence: parameters and intermediates, ended by a byte
+		 * in the range '@' to '~' */
+		for (int i = 2; i < length; i++) {
+			if (buffer[i] >= '@' && buffer[i] <= '~') {
+				event->supported = false;
+				return i + 1;
+			}
+		}
+		if (!flush) {
+			return 0;
+		}
+	} else if (buffer[1] == 'O') {
+		/* Single Shift 3, used by F1-F4 and arrows in application mode */
+		if (length >= 3) {
+			event->supported = false;
+			return 3;
+		}
+		if (!flush) {
+			return 0;
+		}
+	}
+
+	/* Everything else is ALT + key */
+	event->key = buffer[1];
+	event->alt = true;
+	return 2;
+}
+
+/* The slot in a wi_keymap_table for a byte, with or without ALT */
+static inline int keymap_table_slot(const char key, const bool alt) {
+	return (alt ? 256 : 0) + (unsigned char) key;
+}
+
+void compile_keymaps(wi_session* session) {
+	const wi_keymap* maps = session->keymaps;
+	const int amount_maps = session->internal.keymap_array_size;
+
+	/* Count per slot, so the callbacks can be laid out next to each other */
+	int slot_of_map[amount_maps];
+	int amount_in_slot[WI_KEYMAP_TABLE_SLOTS] = { 0 };
+	int amount_callbacks = 0;
+	for (int i = 0; i < amount_maps; i++) {
+		if (maps[i].callback == NULL) {
+			slot_of_map[i] = -1;
+			continue;
+		}
+		slot_of_map[i] = maps[i].modifier == ALT
+			? keymap_table_slot(maps[i].key, true)
+			: keymap_table_slot(convert_key(maps[i]), false);
+		amount_in_slot[slot_of_map[i]]++;
+		amount_callbacks++;
+	}
+
+	wi_keymap_table* table = (wi_keymap_table*) malloc(
+		sizeof(wi_keymap_table)
+		+ amount_callbacks * sizeof(void (*)(const char, wi_session*))
+	);
+	wiAssert(table != NULL, "Failed to allocate keymap-table");
+	table->retired_next = NULL;
+
+	table->start[0] = 0;
+	for (int slot = 0; slot < WI_KEYMAP_TABLE_SLOTS; slot++) {
+		table->start[slot + 1] = table->start[slot] + amount_in_slot[slot];
+	}
+
+	/* Fill in order of the keymap-array, which is the order they get called */
+	int filled_in_slot[WI_KEYMAP_TABLE_SLOTS] = { 0 };
+	for (int i = 0; i < amount_maps; i++) {
+		const int slot = slot_of_map[i];
+		if (slot < 0) {
+			continue;
+		}
+		table->callbacks[table->start[slot] + filled_in_slot[slot]] =
+			maps[i].callback;
+		filled_in_slot[slot]++;
+	}
+
+	wi_keymap_table* old_table =
+		atomic_exchange(&(session->internal.keymap_table), table);
+
+	/* While the session is shown, the input-thread could still be walking
+	 * through the old table, so it can only be freed with the session */
+	if (old_table != NULL && session->internal.input_wake_pipe[0] >= 0) {
+		old_table->retired_next = session->internal.retired_keymap_tables;
+		session->internal.retired_keymap_tables = old_table;
+	} else {
+		free(old_table);
+	}
+}
+
+void dispatch_key(wi_session* session, const key_event event) {
+	const wi_keymap_table* table =
+		atomic_load(&(session->internal.keymap_table));
+	const int slot = keymap_table_slot(event.key, event.alt);
+
+	/* Remember when the first keypress since the last frame came in */
+	if (session->collect_stats && table->start[slot] < table->start[slot + 1]) {
+		long long none = 0;
+		atomic_compare_exchange_strong(
+			&(session->internal.pending_keypress_ns), &none, monotonic_ns()
+		);
+	}
+
+	for (int i = table->start[slot]; i < table->start[slot + 1]; i++) {
+		table->callbacks[i](event.key, session);
+	}
+}
+
+/*
+ * Read everything that is available on stdin into the buffer.
+ * In raw mode (VMIN = 0) `read()` returns 0 when nothing is available,
+ * so that can't be used to detect end-of-file.
+ */
+void read_available_input(char* buffer, int* length, const int capacity) {
+	while (*length < capacity) {
+		long read_result =
+			read(STDIN_FILENO, buffer + *length, capacity - *length);
+		if (read_result > 0) {
+			*length += read_result;
+		} else if (read_result < 0 && errno == EINTR) {
+			continue;
+		} else if (
+			read_result == 0 || errno == EAGAIN || errno == EWOULDBLOCK
+		) {
+			break;
+		} else {
+			wiAssertCallback(0, restore_terminal(), "Error reading key");
+		}
+	}
+}
+
 int input_function(void* arg) {
 	wi_session* session = (wi_session*) arg;
-	wi_keymap* key_maps = session->keymaps;
-	int amount_maps = session->internal.keymap_array_size;
 
-	char c;
+	char buffer[256];
+	int length = 0;
+
+	struct pollfd fds[2] = {
+		{ .fd = STDIN_FILENO, .events = POLLIN },
+		{ .fd = session->internal.input_wake_pipe[0], .events = POLLIN }
+	};
 
 	raw_terminal();
 
 	while (session->keep_running) {
-		c = wi_get_char();
-		if (c > 0) {
-			bool alt_mod = false;
-
-			if (c == '\033') {
-				c = wi_get_char();
-				alt_mod = true;
+		/* When a lone '\033' is waiting, only wait a bit for what follows */
+		const bool waiting_on_escape = length > 0;
+		const int ready =
+			poll(fds, 2, waiting_on_escape ? WI_ESCAPE_TIMEOUT_MS : -1);
+
+		if (fds[1].revents & POLLIN) {
+			char drain[64];
+			while (read(fds[1].fd, drain, sizeof(drain)) > 0);
+		}
+		if (ready > 0 && (fds[0].revents & (POLLIN | POLLHUP))) {
+			const int old_length = length;
+			read_available_input(buffer, &length, sizeof(buffer));
+
+			/* A hung up stdin stays "ready" without ever giving data,
+			 * stop listening to it. Negative fds get ignored by poll(). */
+			if ((fds[0].revents & POLLHUP) && length == old_length) {
+				fds[0].fd = -1;
 			}
+		}
 
+		/* Decode and dispatch everything that is complete */
+		const bool flush =
+			ready == 0 || fds[0].fd < 0 || length == (int) sizeof(buffer);
+		int used = 0;
+		while (used < length && session->keep_running) {
+			key_event event;
+			int amount = decode_key(buffer + used, length - used, flush, &event);
+			if (amount == 0) {
+				break;
+			}
+			used += amount;
 
-			for (int i = 0; i < amount_maps; i++) {
-				if (key_maps[i].callback == NULL) {
-					continue;
-				}
-				if (
-					alt_mod && key_maps[i].modifier == ALT
-					&& key_maps[i].key == c
-				) {
-					key_maps[i].callback(c, session);
-				} else if (c == convert_key(key_maps[i])) {
-					key_maps[i].callback(c, session);
-				}
+			if (event.supported) {
+				dispatch_key(session, event);
 			}
 		}
 
-		/* Sleep for 10ms */
-		thrd_sleep(
-			&(struct timespec) { .tv_sec = 0, .tv_nsec = 1e7 },
-			NULL /* No need to catch remaining time on interrupt */
-		);
+		/* Keep an incomplete sequence for the next round */
+		memmove(buffer, buffer + used, length - used);
+		length -= used;
 	}
 
 	restore_terminal();
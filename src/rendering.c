@@ -1,10 +1,17 @@
-#include <signal.h>		/* struct sigaction, sigaction, SIGINT */
+#include <errno.h>		/* errno, EINTR, EAGAIN */
+#include <fcntl.h>		/* fcntl(), O_NONBLOCK, FD_CLOEXEC */
+#include <limits.h>		/* INT_MAX */
+#include <poll.h>		/* poll(), struct pollfd */
+#include <signal.h>		/* struct sigaction, sigaction, SIGINT, SIGWINCH */
 #include <stdatomic.h>	/* atomic_bool */
 #include <stdbool.h>	/* true, false */
-#include <stdio.h>		/* printf() */
-#include <string.h>		/* strlen() */
+#include <stdint.h>		/* SIZE_MAX, uint64_t */
+#include <stdlib.h>		/* realloc() */
+#include <string.h>		/* strlen(), memcpy(), memset() */
 #include <sys/ioctl.h>	/* ioctl() */
 #include <threads.h>	/* thrd_t, thrd_create, thrd_join */
+#include <time.h>		/* clock_gettime(), CLOCK_MONOTONIC */
+#include <unistd.h>		/* write(), read(), pipe(), sysconf(), STDOUT_FILENO */
 
 #include "wiAssert.h" 	/* wiAssert() */
 
@@ -19,46 +26,152 @@ typedef struct terminal_size {
 	int cols;
 } terminal_size;
 
-static inline void clear_screen(void) {
-	printf("\033[1;1H\033[2J");
-}
+/*
+ * Make sure there is room for at least `extra` more bytes in the buffer.
+ * Grows by doubling, so a session quickly settles on a buffer big enough
+ * for its frames and stops reallocating.
+ */
+static void fb_reserve(wi_frame_buffer* fb, const size_t extra) {
+	if (fb->length + extra <= fb->capacity) {
+		return;
+	}
 
-static inline void cursor_move_up(const unsigned int x) {
-	if (x > 0) {
-		printf("\033[%dA", x);
+	size_t new_capacity = fb->capacity == 0 ? 4096 : fb->capacity;
+	while (new_capacity < fb->length + extra) {
+		new_capacity *= 2;
 	}
+	fb->data = (char*) realloc(fb->data, new_capacity);
+	wiAssertCallback(
+		fb->data != NULL, restore_terminal(),
+		"Failed to grow the frame-buffer"
+	);
+	fb->capacity = new_capacity;
 }
 
-static inline void cursor_move_down(const unsigned int x) {
-	if (x > 0) {
-		printf("\033[%dB", x);
+static inline void fb_append(
+	wi_frame_buffer* fb, const char* bytes, const size_t amount
+) {
+	fb_reserve(fb, amount);
+	memcpy(fb->data + fb->length, bytes, amount);
+	fb->length += amount;
+}
+
+static inline void fb_append_string(wi_frame_buffer* fb, const char* string) {
+	fb_append(fb, string, strlen(string));
+}
+
+static inline void fb_append_char(wi_frame_buffer* fb, const char c) {
+	fb_reserve(fb, 1);
+	fb->data[fb->length++] = c;
+}
+
+/* Append `amount` times the character `c`, used for padding */
+static inline void fb_append_repeated(
+	wi_frame_buffer* fb, const char c, const int amount
+) {
+	if (amount <= 0) {
+		return;
 	}
+	fb_reserve(fb, amount);
+	memset(fb->data + fb->length, c, amount);
+	fb->length += amount;
 }
 
-static inline void cursor_move_right(const unsigned int y) {
-	if (y > 0) {
-		printf("\033[%dC", y);
+/*
+ * Append the decimal representation of `x`.
+ * Hand-rolled because going through `snprintf()` for every cursor-movement
+ * is by far the most expensive part of emitting one.
+ */
+static void fb_append_uint(wi_frame_buffer* fb, unsigned int x) {
+	char digits[10]; /* UINT_MAX has 10 digits */
+	int amount = 0;
+	do {
+		digits[sizeof(digits) - 1 - amount] = '0' + x % 10;
+		x /= 10;
+		amount++;
+	} while (x > 0);
+
+	fb_append(fb, digits + sizeof(digits) - amount, amount);
+}
+
+/*
+ * Hand the whole buffer to the terminal and empty it.
+ * `write()` may write less then asked (or get interrupted by a signal),
+ * so keep going until everything is out. Stdin is non-blocking, which a
+ * terminal shares with stdout, so a full terminal has to be waited for.
+ */
+static void fb_flush(wi_frame_buffer* fb) {
+	size_t written = 0;
+	while (written < fb->length) {
+		ssize_t result =
+			write(STDOUT_FILENO, fb->data + written, fb->length - written);
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				struct pollfd out = { .fd = STDOUT_FILENO, .events = POLLOUT };
+				poll(&out, 1, -1);
+				continue;
+			}
+			break; /* Nothing sensible left to do with this frame */
+		}
+		written += result;
 	}
+	fb->length = 0;
+}
+
+static inline void clear_screen(wi_frame_buffer* fb) {
+	fb_append_string(fb, "\033[1;1H\033[2J");
 }
 
-static inline void cursor_move_left(const unsigned int y) {
-	if (y > 0) {
-		printf("\033[%dD", y);
+/* Append '\033[<x><code>', the shape of all relative cursor-movements */
+static inline void cursor_move(
+	wi_frame_buffer* fb, const unsigned int x, const char code
+) {
+	if (x > 0) {
+		fb_append(fb, "\033[", 2);
+		fb_append_uint(fb, x);
+		fb_append_char(fb, code);
 	}
 }
 
+static inline void cursor_move_up(wi_frame_buffer* fb, const unsigned int x) {
+	cursor_move(fb, x, 'A');
+}
+
+static inline void cursor_move_down(wi_frame_buffer* fb, const unsigned int x) {
+	cursor_move(fb, x, 'B');
+}
+
+static inline void cursor_move_right(wi_frame_buffer* fb, const unsigned int y) {
+	cursor_move(fb, y, 'C');
+}
+
+static inline void cursor_move_left(wi_frame_buffer* fb, const unsigned int y) {
+	cursor_move(fb, y, 'D');
+}
+
 /*
  * Move the cursor to an absolute position in the terminal.
  */
-static inline void cursor_go_to(const int row, const int col) {
-	printf("\033[%d;%dH", col, row);
+static inline void cursor_go_to(
+	wi_frame_buffer* fb, const int row, const int col
+) {
+	fb_append(fb, "\033[", 2);
+	fb_append_uint(fb, col);
+	fb_append_char(fb, ';');
+	fb_append_uint(fb, row);
+	fb_append_char(fb, 'H');
 }
 
 /*
  * Move the cursor to an absolute row in the terminal.
  */
-static inline void cursor_go_to_row(const int row) {
-	printf("\033[%dH", row);
+static inline void cursor_go_to_row(wi_frame_buffer* fb, const int row) {
+	fb_append(fb, "\033[", 2);
+	fb_append_uint(fb, row);
+	fb_append_char(fb, 'H');
 }
 
 /*
@@ -73,28 +186,107 @@ terminal_size get_terminal_size(void) {
 	return (terminal_size) { max.ws_row, max.ws_col };
 }
 
+/* Rewrap one window, run on the wrap-pool */
+static void resize_window_task(void* window) {
+	resize_window_content((wi_window*) window);
+}
+
+/*
+ * Rewrap the wrapping windows for their rendered width, spread over the
+ * wrap-pool. This has to happen after every dimension-calculation, as
+ * wrapping windows can only calculate their content once their width is
+ * known.
+ * A depending window picks its content with the cursor of the window it
+ * depends on, which moves along when that one gets rewrapped, so it waits
+ * for that one to be done.
+ */
+static void update_wrapped_windows(wi_session* session) {
+	int amount_pending = 0;
+	for (int i = 0; i < session->internal.amount_rows; i++) {
+		for (int j = 0; j < session->internal.amount_cols[i]; j++) {
+			if (session->windows[i][j]->wrap_text) {
+				amount_pending++;
+			}
+		}
+	}
+	if (amount_pending == 0) {
+		return;
+	}
+
+	wi_window* pending[amount_pending];
+	void* ready[amount_pending];
+	bool is_ready[amount_pending];
+	amount_pending = 0;
+	for (int i = 0; i < session->internal.amount_rows; i++) {
+		for (int j = 0; j < session->internal.amount_cols[i]; j++) {
+			if (session->windows[i][j]->wrap_text) {
+				pending[amount_pending] = session->windows[i][j];
+				amount_pending++;
+			}
+		}
+	}
+
+	while (amount_pending > 0) {
+		int amount_ready = 0;
+		for (int i = 0; i < amount_pending; i++) {
+			is_ready[i] = true;
+			for (int j = 0; j < amount_pending; j++) {
+				if (pending[i]->depends_on == pending[j]) {
+					is_ready[i] = false;
+				}
+			}
+			if (is_ready[i]) {
+				ready[amount_ready] = pending[i];
+				amount_ready++;
+			}
+		}
+
+		/* Windows depending on each other in a circle, just go in order */
+		if (amount_ready == 0) {
+			for (int i = 0; i < amount_pending; i++) {
+				is_ready[i] = true;
+				ready[i] = pending[i];
+			}
+			amount_ready = amount_pending;
+		}
+
+		run_in_thread_pool(
+			session->internal.wrap_pool, resize_window_task, ready, amount_ready
+		);
+
+		int amount_left = 0;
+		for (int i = 0; i < amount_pending; i++) {
+			if (!is_ready[i]) {
+				pending[amount_left] = pending[i];
+				amount_left++;
+			}
+		}
+		amount_pending = amount_left;
+	}
+}
+
 /*
  * Per row, calculate the rendered width for each window.
  * This only changes when the normal width is set to -1.
  * When multiple windows have their width set to -1, the available space
  * will be distributed equally between them.
  *
- * When the previous window-size is the same as in the previous call, this
- * will do nothing and return false.
+ * When the size is the same as in the previous calculation for this session,
+ * this will do nothing and return false.
  *
  * @returns: if dimensions were re-calculated
  */
-bool calculate_window_dimension(wi_session* session) {
-	static terminal_size previous_size; /* static is auto initialised to 0 */
-	terminal_size current_size = get_terminal_size();
-
+static bool apply_terminal_size(
+	wi_session* session, const terminal_size current_size
+) {
 	if (
-		current_size.cols == previous_size.cols
-		&& current_size.rows == previous_size.rows
+		current_size.cols == session->internal.terminal_cols
+		&& current_size.rows == session->internal.terminal_rows
 	) {
 		return false;
 	}
-	previous_size = current_size;
+	session->internal.terminal_rows = current_size.rows;
+	session->internal.terminal_cols = current_size.cols;
 
 	const int available_width = current_size.cols;
 
@@ -149,32 +341,137 @@ bool calculate_window_dimension(wi_session* session) {
 			if (col < left_over) {
 				windows_to_compute[col]->internal.rendered_width++;
 			}
-			wi_update_content(window);
 		}
 	}
+	update_wrapped_windows(session);
 
 	return true;
 }
 
-static inline void print_side_border(const char* border, const char* effect) {
-	if (border == NULL) {
-		puts("\033[0m");
-	} else {
-		printf("\033[0m%s%s\033[0m", effect, border);
+/*
+ * Calculate the window-dimensions for the current terminal-size.
+ * The terminal is only asked for its size when a resize is pending (see
+ * `handle_sigwinch`), so this is cheap to call every frame.
+ *
+ * @returns: if dimensions were re-calculated
+ */
+bool calculate_window_dimension(wi_session* session) {
+	if (!atomic_exchange(&(session->internal.resize_pending), false)) {
+		return false;
+	}
+	return apply_terminal_size(session, get_terminal_size());
+}
+
+
+static inline void print_side_border(
+	wi_frame_buffer* fb, const char* border, const char* effect
+) {
+	fb_append_string(fb, "\033[0m");
+	if (border != NULL) {
+		fb_append_string(fb, effect);
+		fb_append_string(fb, border);
+		fb_append_string(fb, "\033[0m");
+	}
+}
+
+/*
+ * The bytes of plain ASCII from `byte` on, up to the next escape-sequence
+ * or the end of the line. Those are as wide as they are long, which no
+ * other character is, so that's all it takes to tell.
+ *
+ * @returns: the length of the run, 0 when it holds any other character
+ */
+static inline int plain_run(
+	const wi_style_span* spans, const int amount_spans, const int span,
+	const int byte, const int column, const int line_bytes, const int line_width
+) {
+	const int end_byte = span < amount_spans ? (int) spans[span].bytes : line_bytes;
+	const int end_column = span < amount_spans ? (int) spans[span].width : line_width;
+	return end_byte - byte == end_column - column ? end_byte - byte : 0;
+}
+
+/*
+ * A wrapped line goes on in the markup of the lines it was wrapped from,
+ * which the side-border before it reset. Replay that markup, from where it
+ * was last reset in the same line of the original on.
+ */
+static void replay_wrapped_style(
+	wi_frame_buffer* fb, const wi_content* content, const int line
+) {
+	const wi_carried_style carried = find_carried_style(content, line);
+
+	/* Only the lines with markup are visited */
+	int from_span = carried.span;
+	for (int i = carried.line; i >= 0; i = find_carried_style(content, i).next_line) {
+		int amount_spans;
+		const wi_style_span* spans = find_style_spans(content, i, &amount_spans);
+		const char* string = content->line_list[i].string;
+		for (int j = from_span; j < amount_spans; j++) {
+			fb_append(fb, string + spans[j].bytes, spans[j].length);
+		}
+		if (i == carried.last_line) {
+			break;
+		}
+		from_span = 0;
+	}
+}
+
+/* Height of a window on the screen, including its border */
+static inline int window_printed_height(const wi_window* window) {
+	int height = window->internal.rendered_height;
+	if (window->border.side_top != NULL) {
+		height++;
+	}
+	if (window->border.side_bottom != NULL) {
+		height++;
 	}
+	return height;
 }
 
-void render_content(const wi_window* window, const int horizontal_offset) {
-	/* Extract the needed variables */
-	const wi_content content = wi_get_current_window_content(window);
-	const int window_width    = window->internal.rendered_width;
-	const int window_height   = window->internal.rendered_height;
-	const wi_border border    = window->border;
-	const char* effect = window->internal.currently_focussed
-		? border.focussed_colour : border.unfocussed_colour;
+/* Width of a window on the screen, including its border */
+static inline int window_printed_width(const wi_window* window) {
+	int width = window->internal.rendered_width;
+	if (window->border.side_left != NULL) {
+		width++;
+	}
+	if (window->border.side_right != NULL) {
+		width++;
+	}
+	return width;
+}
+
+/*
+ * What it takes to draw a window one line at a time, worked out once for
+ * all of its lines.
+ */
+typedef struct {
+	const wi_window* window;
+	int column;			/* Where the window starts in the frame */
+	int printed_height;
+	const char* effect;	/* Of the border */
+	wi_content content;
+	wi_position cursor;	/* Moved onto the content */
+	int char_offset;
+	bool do_line_cursor;
+	bool do_point_cursor;
+} window_lines;
+
+static void prepare_window_lines(
+	window_lines* lines, const wi_window* window, const int column
+) {
+	/* Lazily split content only has to be split as far as it is visible */
+	split_window_lines(
+		window, window->internal.offset_cursor.row + window->internal.rendered_height
+	);
+
+	lines->window = window;
+	lines->column = column;
+	lines->printed_height = window_printed_height(window);
+	lines->content = wi_get_current_window_content(window);
+	lines->effect = window->internal.currently_focussed
+		? window->border.focussed_colour : window->border.unfocussed_colour;
 
 	/* Cursor variables */
-	wi_position cursor = window->internal.visual_cursor;
 	bool focus_in_depending_window = false;
 	for (int i = 0; i < window->internal.amount_depending; i++) {
 		if (window->internal.depending_windows[i]->internal.currently_focussed) {
@@ -182,129 +479,223 @@ void render_content(const wi_window* window, const int horizontal_offset) {
 			break;
 		}
 	}
-	bool do_line_cursor =
+	lines->do_line_cursor =
 		(window->internal.currently_focussed || focus_in_depending_window)
 		&& window->cursor_rendering == LINEBASED;
-	bool do_point_cursor =
+	lines->do_point_cursor =
 		(window->internal.currently_focussed || focus_in_depending_window)
 		&& window->cursor_rendering == POINTBASED;
 
-	const int starting_row = window->internal.offset_cursor.row;
-	int char_offset = window->internal.offset_cursor.col;
-
 	wiAssertCallback(
-		content.line_list != NULL, restore_terminal(),
+		lines->content.line_list != NULL, restore_terminal(),
 	);
-	int cursor_line_length =
-		content.line_list[cursor.row + starting_row].length.width;
+	const wi_position cursor = window->internal.visual_cursor;
+	const int cursor_line_length = lines->content.line_list[
+		cursor.row + window->internal.offset_cursor.row
+	].length.width;
 
 	/* Make sure that the cursor is on the content. */
-	if (char_offset >= cursor_line_length) {
-		char_offset = cursor_line_length - 1;
+	lines->cursor = cursor;
+	lines->char_offset = window->internal.offset_cursor.col;
+	if (lines->char_offset >= cursor_line_length) {
+		lines->char_offset = cursor_line_length - 1;
 	}
-	if (char_offset + cursor.col >= cursor_line_length) {
-		cursor.col = cursor_line_length - char_offset - 1;
+	if (lines->char_offset + cursor.col >= cursor_line_length) {
+		lines->cursor.col = cursor_line_length - lines->char_offset - 1;
 	}
+}
 
+/*
+ * Render one row of the content of a window, between its side-borders.
+ * Does not jump horizontally and does not place a newline.
+ */
+static void render_content_line(
+	wi_frame_buffer* fb, const window_lines* lines, const int printed_row
+) {
+	const wi_window* window = lines->window;
+	const wi_content* content = &(lines->content);
+	const int window_width = window->internal.rendered_width;
+	const wi_position cursor = lines->cursor;
+	const int char_offset = lines->char_offset;
+	const int line = printed_row + window->internal.offset_cursor.row;
+
+	print_side_border(fb, window->border.side_left, lines->effect);
+
+	/* Fill the height below the content with emptiness */
+	if (line >= content->amount_lines) {
+		fb_append_repeated(fb, ' ', window_width);
+		print_side_border(fb, window->border.side_right, lines->effect);
+		return;
+	}
 
 	/* Variables to keep track of where I am */
-	int printed_rows = 0;
-	int skipped_chars;
-	int printed_chars;
-	int current_byte;
-	int current_line_length; /* In visual characters */
-	char* current_line;
-
-	/* Print lines with content */
+	int printed_chars = 0;
+	char* current_line = content->line_list[line].string;
+	const int current_line_length = content->line_list[line].length.width;
+	const int line_bytes = content->line_list[line].length.bytes;
+
+	int amount_spans;
+	const wi_style_span* spans = find_style_spans(content, line, &amount_spans);
+	int span = 0;
+
+	/* Wrapped lines go on in the markup the lines before them ended in */
+	replay_wrapped_style(fb, content, line);
+
+	/* Jump close to 'char_offset' in long lines */
+	const wi_column_checkpoint checkpoint =
+		find_column_checkpoint(content, line, char_offset);
+	int current_byte = checkpoint.bytes;
+	int skipped_chars = checkpoint.width;
+	while (span < amount_spans && (int) spans[span].bytes < current_byte) {
+		span++;
+	}
+
+	/* Skip first 'char_offset' characters, stepping over whole runs of
+	 * plain text between the escape-sequences at once */
+	while (skipped_chars < char_offset && skipped_chars < current_line_length) {
+		if (span < amount_spans && (int) spans[span].bytes == current_byte) {
+			current_byte += spans[span].length;
+			span++;
+			continue;
+		}
+		const int run = plain_run(
+			spans, amount_spans, span, current_byte, skipped_chars,
+			line_bytes, current_line_length
+		);
+		if (run > 0) {
+			const int step = run < char_offset - skipped_chars
+				? run : char_offset - skipped_chars;
+			current_byte += step;
+			skipped_chars += step;
+			continue;
+		}
+		wi_string_length char_length =
+			wi_char_byte_size(current_line + current_byte);
+		current_byte += char_length.bytes;
+		skipped_chars += char_length.width;
+	}
+
+	/* Only the markup skipped over since it was last reset still applies */
+	int replay_from = span;
+	while (replay_from > 0 && !spans[replay_from - 1].resets) {
+		replay_from--;
+	}
+	if (replay_from > 0) {
+		replay_from--;
+	}
+	for (int i = replay_from; i < span; i++) {
+		fb_append(fb, current_line + spans[i].bytes, spans[i].length);
+	}
+
+	/* Line cursor */
+	bool line_cursor = printed_row == cursor.row && lines->do_line_cursor;
+	if (line_cursor) {
+		fb_append_string(fb, "\033[7m");
+	}
+
+	/* A wide character cut in half by the offset leaves a gap */
+	if (char_offset > 0 && skipped_chars > char_offset) {
+		printed_chars = skipped_chars - char_offset;
+		fb_append_repeated(fb, ' ', printed_chars);
+		skipped_chars = char_offset;
+	}
+
+	/* Print out the content */
+	const bool cursor_on_line =
+		printed_row == cursor.row && lines->do_point_cursor;
 	while (
-		printed_rows < window_height
-		&& printed_rows + starting_row < content.amount_lines
+		printed_chars < window_width
+		&& printed_chars + skipped_chars < current_line_length
 	) {
-		cursor_move_right(horizontal_offset);
-		print_side_border(window->border.side_left, effect);
-
-		skipped_chars = 0;
-		printed_chars = 0;
-		current_byte  = 0;
-		current_line  = content.line_list[printed_rows + starting_row].string;
-		current_line_length =
-			content.line_list[printed_rows + starting_row].length.width;
-
-		/* Skip first 'char_offset' characters, but do print the ansii escape
-		 * codes for text markup */
-		while (skipped_chars < char_offset && skipped_chars < current_line_length) {
-			wi_string_length char_length =
-				wi_char_byte_size(current_line + current_byte);
-			if (current_line[current_byte] == '\033') {
-				printf("%.*s", char_length.bytes, current_line + current_byte);
-			}
-			current_byte += char_length.bytes;
-			skipped_chars += char_length.width;
-		}
-
-		/* Line cursor */
-		bool line_cursor = printed_rows == cursor.row && do_line_cursor;
-		if (line_cursor) {
-			printf("\033[7m");
-		}
-
-		/* Print out the content */
-		while (
-			printed_chars < window_width
-			&& printed_chars + skipped_chars < current_line_length
-		) {
-			/* Block cursor */
-			bool point_cursor =
-				printed_rows == cursor.row && printed_chars == cursor.col
-				&& do_point_cursor;
-			if (point_cursor) {
-				printf("\033[7m");
-			}
-
-			wi_string_length char_length =
-				wi_char_byte_size(current_line + current_byte);
-			printf("%.*s", char_length.bytes, current_line + current_byte);
-			current_byte += char_length.bytes;
-			printed_chars += char_length.width;
+		if (span < amount_spans && (int) spans[span].bytes == current_byte) {
+			fb_append(fb, current_line + current_byte, spans[span].length);
+			current_byte += spans[span].length;
+			span++;
+			continue;
+		}
 
-			/* Block cursor */
-			if (current_line_length == 0 && (point_cursor || printed_chars == 0)) {
-				printf(" ");
-			}
-			if (point_cursor) {
-				printf("\033[27m"); /* Only stop cursor-effect, not the rest */
-			}
+		/* Plain text goes out in one go, up to the edge or the cursor */
+		int run = plain_run(
+			spans, amount_spans, span, current_byte,
+			skipped_chars + printed_chars, line_bytes, current_line_length
+		);
+		if (run > window_width - printed_chars) {
+			run = window_width - printed_chars;
+		}
+		if (cursor_on_line && cursor.col >= printed_chars
+			&& run > cursor.col - printed_chars) {
+			run = cursor.col - printed_chars;
+		}
+		if (run > 0) {
+			fb_append(fb, current_line + current_byte, run);
+			current_byte += run;
+			printed_chars += run;
+			continue;
 		}
 
-		if (current_line_length == 0 && printed_rows == cursor.row && do_point_cursor) {
-			puts("\033[7m \033[27m");
-			printed_chars = 1;
+		wi_string_length char_length =
+			wi_char_byte_size(current_line + current_byte);
+		if (printed_chars + (int) char_length.width > window_width) {
+			/* A wide character that doesn't fit anymore */
+			break;
 		}
 
-		/* Fill the rest of the line with emptiness */
-		/* Some benchmarking showed that this was a bit faster then a loop */
-		if (printed_chars < window_width) {
-			printf("%*c", window_width - printed_chars, ' ');
+		/* Block cursor, also on the second column of wide characters */
+		bool point_cursor =
+			cursor_on_line
+			&& printed_chars <= cursor.col
+			&& (cursor.col == printed_chars
+				|| cursor.col < printed_chars + (int) char_length.width);
+		if (point_cursor) {
+			fb_append_string(fb, "\033[7m");
 		}
 
-		/* No need to stop line-cursor effect, because when rendering the
-		 * border, all effects are already reset. */
+		fb_append(fb, current_line + current_byte, char_length.bytes);
+		current_byte += char_length.bytes;
+		printed_chars += char_length.width;
 
-		print_side_border(window->border.side_right, effect);
-		putchar('\n');
-		printed_rows++;
+		/* Block cursor */
+		if (current_line_length == 0 && (point_cursor || printed_chars == 0)) {
+			fb_append_char(fb, ' ');
+		}
+		if (point_cursor) {
+			/* Only stop cursor-effect, not the rest */
+			fb_append_string(fb, "\033[27m");
+		}
 	}
 
-	/* Fill remaining height with emptiness */
-	while (printed_rows < window_height) {
-		cursor_move_right(horizontal_offset);
-		print_side_border(window->border.side_left, effect);
-		printf("%*c", window_width, ' ');
-		print_side_border(window->border.side_right, effect);
-		putchar('\n');
+	/* Zero-width characters after the last one printed still belong to it,
+	 * along with the markup in between them */
+	int next_byte = current_byte;
+	int next_span = span;
+	while (printed_chars > 0 && next_byte < line_bytes) {
+		if (next_span < amount_spans && (int) spans[next_span].bytes == next_byte) {
+			next_byte += spans[next_span].length;
+			next_span++;
+			continue;
+		}
+		wi_string_length char_length = wi_char_byte_size(current_line + next_byte);
+		if (char_length.width != 0) {
+			break;
+		}
+		next_byte += char_length.bytes;
+		fb_append(fb, current_line + current_byte, next_byte - current_byte);
+		current_byte = next_byte;
+		span = next_span;
+	}
 
-		printed_rows++;
+	if (current_line_length == 0 && cursor_on_line) {
+		fb_append_string(fb, "\033[7m \033[27m");
+		printed_chars = 1;
 	}
+
+	/* Fill the rest of the line with emptiness */
+	fb_append_repeated(fb, ' ', window_width - printed_chars);
+
+	/* No need to stop line-cursor effect, because when rendering the
+	 * border, all effects are already reset. */
+
+	print_side_border(fb, window->border.side_right, lines->effect);
 }
 
 /*
@@ -318,7 +709,7 @@ void render_content(const wi_window* window, const int horizontal_offset) {
  * The only magic happening, is the alignment.
  */
 void render_horizontal_border(
-	const wi_border border, bool top, const int width
+	wi_frame_buffer* fb, const wi_border border, bool top, const int width
 ) {
 	const char* info = top ? border.title : border.footer;
 	const wi_info_alignment alignment =
@@ -326,6 +717,7 @@ void render_horizontal_border(
 	const char* left = top ? border.corner_top_left : border.corner_bottom_left;
 	const char* right = top ? border.corner_top_right : border.corner_bottom_right;
 	const char* mid = top ? border.side_top : border.side_bottom;
+	const size_t mid_length = strlen(mid);
 
 	int info_length = info == NULL ? 0 : wi_strlen(info).width;
 	int left_pad = 0;
@@ -350,9 +742,9 @@ void render_horizontal_border(
 			break;
 	}
 
-	if (border.side_left) printf("%s", left);
+	if (border.side_left) fb_append_string(fb, left);
 	for (int _ = 0; _ < left_pad; _++) {
-		printf("%s", mid);
+		fb_append(fb, mid, mid_length);
 	}
 
 	/* Restrain info-length if necessary (can't be longer then window-width)
@@ -361,141 +753,1693 @@ void render_horizontal_border(
 	wi_string_length printed = { 0, 0 };
 	while ((int) printed.width < info_length) {
 		temp = wi_char_byte_size(info + printed.bytes);
-		printf("%.*s", temp.bytes, info + printed.bytes);
+		if ((int) (printed.width + temp.width) > info_length) {
+			/* A wide character that doesn't fit leaves a gap */
+			right_pad += info_length - printed.width;
+			break;
+		}
+		fb_append(fb, info + printed.bytes, temp.bytes);
 		printed.bytes += temp.bytes;
 		printed.width += temp.width;
 	}
 
 	for (int _ = 0; _ < right_pad; _++) {
-		printf("%s", mid);
+		fb_append(fb, mid, mid_length);
 	}
 
-	if (border.side_right) printf("%s", right);
+	if (border.side_right) fb_append_string(fb, right);
 }
 
 /*
- * Render a window at the given `horizontal_offset`.
- * This assumes that the cursor already is at the right vertical space.
+ * Render one line of a window: a horizontal border or a row of its content.
+ * Does not jump horizontally and does not place a newline.
  */
-void render_window(const wi_window* window, const int horizontal_offset) {
+static void render_window_line(
+	wi_frame_buffer* fb, const window_lines* lines, int line
+) {
+	const wi_window* window = lines->window;
 	const wi_border border = window->border;
-	char* effect = "";
 
 	if (border.side_top != NULL) {
-		if (window->internal.currently_focussed) {
-			effect = border.focussed_colour;
-		} else {
-			effect = border.unfocussed_colour;
+		if (line == 0) {
+			fb_append_string(fb, lines->effect);
+			render_horizontal_border(
+				fb, border, true, window->internal.rendered_width
+			);
+			fb_append_string(fb, "\033[0m");
+			return;
+		}
+		line--;
+	}
+
+	if (line == window->internal.rendered_height) {
+		fb_append_string(fb, lines->effect);
+		render_horizontal_border(
+			fb, border, false, window->internal.rendered_width
+		);
+		fb_append_string(fb, "\033[0m");
+		return;
+	}
+
+	render_content_line(fb, lines, line);
+}
+
+/*
+ * Calculate how many rows and columns a frame of the session will take up
+ * on the screen, with the currently rendered window-sizes.
+ *
+ * @returns: struct with the size of the frame
+ */
+terminal_size frame_size(const wi_session* session) {
+	terminal_size size = { 0, 0 };
+
+	for (int row = 0; row < session->internal.amount_rows; row++) {
+		int row_width = 0;
+		int row_height = 0;
+		for (int col = 0; col < session->internal.amount_cols[row]; col++) {
+			const wi_window* window = session->windows[row][col];
+			row_width += window_printed_width(window);
+			if (window_printed_height(window) > row_height) {
+				row_height = window_printed_height(window);
+			}
 		}
 
-		cursor_move_right(horizontal_offset);
-		printf("%s", effect);
-		render_horizontal_border(border, true, window->internal.rendered_width);
-		printf("\033[0m\n");
+		size.rows += row_height;
+		if (row_width > size.cols) {
+			size.cols = row_width;
+		}
 	}
 
-	render_content(window, horizontal_offset);
+	return size;
+}
 
-	if (border.side_bottom != NULL) {
-		cursor_move_right(horizontal_offset);
-		printf("%s", effect);
-		render_horizontal_border(border, false, window->internal.rendered_width);
-		printf("\033[0m\n");
+/*
+ * Mark all windows of the session as changed, for when the whole session
+ * has to be redrawn.
+ */
+static void mark_session_dirty(wi_session* session) {
+	for (int row = 0; row < session->internal.amount_rows; row++) {
+		for (int col = 0; col < session->internal.amount_cols[row]; col++) {
+			atomic_store(&(session->windows[row][col]->internal.dirty), true);
+		}
 	}
 }
 
-int wi_render_frame(wi_session* session) {
-	int accumulated_row_width;
-	int max_row_height;
-	int accumulated_height = 0;
+/*
+ * A window has to be redrawn when it is marked as changed, or when it
+ * depends on a window whose cursor moved to a different content.
+ */
+static bool window_needs_redraw(const wi_window* window) {
+	if (atomic_load(&(window->internal.dirty))) {
+		return true;
+	}
+	return window->depends_on != NULL
+		&& wi_get_current_window_content(window).original.string
+			!= window->internal.rendered_content;
+}
 
-	wi_window* window;
+/*
+ * Put the cursor of a window on the last line of its content, as low in the
+ * window as it goes, when `follow_tail` asked for it.
+ */
+static void follow_tail(wi_window* window) {
+	if (!window->internal.follow_pending) {
+		return;
+	}
+
+	split_window_lines(window, INT_MAX);
+	const wi_content* content = current_window_content(window);
+	if (content->line_list == NULL) {
+		/* Not wrapped yet, try again next frame */
+		return;
+	}
+	window->internal.follow_pending = false;
+
+	const int last_line = content->amount_lines > 0
+		? content->amount_lines - 1 : 0;
+	int visual_row = window->internal.rendered_height - 1;
+	if (visual_row > last_line) {
+		visual_row = last_line;
+	}
+	if (visual_row < 0) {
+		visual_row = 0;
+	}
+
+	window->internal.visual_cursor.row = visual_row;
+	window->internal.offset_cursor.row = last_line - visual_row;
+}
+
+/* Move the cursor down from the start of one line in the frame to another */
+static inline void cursor_move_to_row(
+	wi_frame_buffer* fb, int* current_row, const int row
+) {
+	cursor_move_down(fb, row - *current_row);
+	*current_row = row;
+}
+
+/*
+ * Append the windows of the session that need to be redrawn to the
+ * frame-buffer, without writing anything out yet.
+ * Each row of windows is drawn a line at a time, going from one window to
+ * the next on the same line, so the frame goes from top to bottom without
+ * ever moving the cursor back up.
+ * The cursor is assumed to be at the top-left of the frame, and is left
+ * just below the frame.
+ *
+ * @returns: height of the frame.
+ */
+int render_session(wi_frame_buffer* fb, wi_session* session) {
+	int accumulated_height = 0;
+	int cursor_row = 0; /* Always in the first column of the frame */
+	int windows_redrawn = 0;
 
 	for (int row = 0; row < session->internal.amount_rows; row++) {
-		accumulated_row_width = 0;
-		max_row_height = 0;
+		const int amount_cols = session->internal.amount_cols[row];
+		if (amount_cols == 0) {
+			continue;
+		}
 
-		for (int col = 0; col < session->internal.amount_cols[row]; col++) {
-			window = session->windows[row][col];
+		window_lines redrawn[amount_cols];
+		int amount_redrawn = 0;
+		int accumulated_row_width = 0;
+		int max_row_height = 0;
 
-			render_window(window, accumulated_row_width);
+		for (int col = 0; col < amount_cols; col++) {
+			wi_window* window = session->windows[row][col];
 
-			int printed_height = window->internal.rendered_height;
-			if (window->border.side_top != NULL) {
-				printed_height++;
+			if (window_needs_redraw(window)) {
+				/* Cleared before rendering, so that changes made while
+				 * rendering are not lost */
+				atomic_store(&(window->internal.dirty), false);
+				follow_tail(window);
+				window->internal.rendered_content =
+					wi_get_current_window_content(window).original.string;
+
+				prepare_window_lines(
+					&(redrawn[amount_redrawn]), window, accumulated_row_width
+				);
+				amount_redrawn++;
 			}
-			if (window->border.side_bottom != NULL) {
-				printed_height++;
-			}
-			cursor_move_up(printed_height);
 
-			accumulated_row_width += window->internal.rendered_width;
-			if (window->border.side_left != NULL) {
-				accumulated_row_width += 1;
-			}
-			if (window->border.side_right != NULL) {
-				accumulated_row_width += 1;
+			accumulated_row_width += window_printed_width(window);
+
+			if (window_printed_height(window) > max_row_height) {
+				max_row_height = window_printed_height(window);
 			}
+		}
+		windows_redrawn += amount_redrawn;
 
-			if (printed_height > max_row_height) {
-				max_row_height = printed_height;
+		for (int line = 0; line < max_row_height; line++) {
+			int column = -1; /* Not on this line yet */
+			for (int i = 0; i < amount_redrawn; i++) {
+				if (line >= redrawn[i].printed_height) {
+					continue;
+				}
+				if (column < 0) {
+					cursor_move_to_row(fb, &cursor_row, accumulated_height + line);
+					column = 0;
+				}
+				cursor_move_right(fb, redrawn[i].column - column);
+				render_window_line(fb, &(redrawn[i]), line);
+				column = redrawn[i].column + window_printed_width(redrawn[i].window);
+			}
+			if (column >= 0) {
+				fb_append_char(fb, '\n');
+				cursor_row++;
 			}
 		}
-		cursor_move_down(max_row_height);
 
 		accumulated_height += max_row_height;
 	}
+	cursor_move_to_row(fb, &cursor_row, accumulated_height);
+	session->internal.frame_windows_redrawn = windows_redrawn;
 
 	return accumulated_height;
 }
 
-int render_function(void* arg) {
-	wi_session* session = (wi_session*) arg;
-	int printed_height = 0;
+/* Kinds of colours, in the top byte of `wi_style.foreground/background` */
+#define WI_COLOUR_KIND		(0xFFu << 24)
+#define WI_COLOUR_BASIC		(1u << 24)	/* 0-7, and 8-15 for the bright ones */
+#define WI_COLOUR_INDEXED	(2u << 24)	/* 0-255 */
+#define WI_COLOUR_RGB		(3u << 24)	/* 0xRRGGBB */
 
-	calculate_window_dimension(session);
-	atomic_store(&(session->need_rerender), true);
+#define WI_EFFECT(n) (1u << (n))
 
-	/* Wrapping windows have not yet calculated their content yet,
-	 * do that now we know the sizes. */
-	for (int i = 0; i < session->internal.amount_rows; i++) {
-		for (int j = 0; j < session->internal.amount_cols[i]; j++) {
-			wi_window* window = session->windows[i][j];
-			if (window->wrap_text) {
-				wi_update_content(window);
-			}
-		}
-	}
+/* Parameters a `wi_screen` interns at most, like its styles */
+#define WI_SCREEN_MAX_EXTRAS 256
 
-	while (session->keep_running) {
-		bool dimensions_changed = calculate_window_dimension(session);
-		if (dimensions_changed || atomic_load(&(session->need_rerender))) {
-			if (session->start_clear_screen || dimensions_changed) {
-				clear_screen();
-			} else {
-				cursor_move_up(printed_height);
-			}
-			printed_height = wi_render_frame(session);
-			atomic_store(&(session->need_rerender), false);
+static const wi_style default_style = { 0, 0, 0, 0, 0 };
+
+static inline bool styles_equal(const wi_style* a, const wi_style* b) {
+	return a->effects == b->effects && a->underline == b->underline
+		&& a->foreground == b->foreground && a->background == b->background
+		&& a->extra == b->extra;
+}
+
+static inline unsigned int style_hash(const wi_style* style) {
+	uint64_t hash = style->effects
+		| (uint64_t) style->underline << 16 | (uint64_t) style->extra << 24;
+	hash = (hash ^ style->foreground) * 0x9E3779B97F4A7C15u;
+	hash = (hash ^ style->background) * 0x9E3779B97F4A7C15u;
+	return hash >> 32;
+}
+
+/*
+ * Find the index of a style in the table of the screen, adding it when it
+ * is not yet in there.
+ *
+ * @returns: index of the style, -1 when the table is full
+ */
+static int screen_intern_style(wi_screen* screen, const wi_style* style) {
+	unsigned int slot = style_hash(style) % WI_STYLE_SLOTS;
+	while (screen->style_slots[slot] != 0) {
+		const int index = screen->style_slots[slot] - 1;
+		if (styles_equal(&(screen->styles[index]), style)) {
+			return index;
 		}
+		slot = (slot + 1) % WI_STYLE_SLOTS;
+	}
 
-		/* Sleep for 10ms */
-		thrd_sleep(
-			&(struct timespec) { .tv_sec = 0, .tv_nsec = 1e7 },
-			NULL /* No need to catch remaining time on interrupt */
+	if (screen->amount_styles >= WI_SCREEN_MAX_STYLES) {
+		return -1;
+	}
+	if (screen->amount_styles >= screen->styles_capacity) {
+		screen->styles_capacity =
+			screen->styles_capacity == 0 ? 16 : screen->styles_capacity * 2;
+		screen->styles = (wi_style*) realloc(
+			screen->styles, screen->styles_capacity * sizeof(wi_style)
+		);
+		wiAssertCallback(
+			screen->styles != NULL, restore_terminal(),
+			"Failed to grow the style-table"
 		);
 	}
+	screen->styles[screen->amount_styles] = *style;
+	screen->style_slots[slot] = screen->amount_styles + 1;
 
-	return 0;
-}
-
-void handle_sigint(int _) {
-	(void)(_);
-	restore_terminal();
-	exit(0);
+	return screen->amount_styles++;
 }
 
-void wi_show_session(wi_session* session) {
+/*
+ * Same as `screen_intern_style()`, but for the parameters styles don't
+ * know themselves. There are few of those, so they are simply searched.
+ *
+ * @returns: index of the parameters, -1 when there are too many
+ */
+static int screen_intern_extra(
+	wi_screen* screen, const char* extra, const size_t length
+) {
+	for (int i = 0; i < screen->amount_extras; i++) {
+		if (
+			strncmp(screen->extras[i], extra, length) == 0
+			&& screen->extras[i][length] == '\0'
+		) {
+			return i;
+		}
+	}
+
+	if (screen->amount_extras >= WI_SCREEN_MAX_EXTRAS) {
+		return -1;
+	}
+	if (screen->amount_extras >= screen->extras_capacity) {
+		screen->extras_capacity =
+			screen->extras_capacity == 0 ? 4 : screen->extras_capacity * 2;
+		screen->extras = (char**) realloc(
+			screen->extras, screen->extras_capacity * sizeof(char*)
+		);
+		wiAssertCallback(
+			screen->extras != NULL, restore_terminal(),
+			"Failed to grow the style-table"
+		);
+	}
+	screen->extras[screen->amount_extras] = strndup(extra, length);
+	wiAssertCallback(
+		screen->extras[screen->amount_extras] != NULL, restore_terminal(),
+		"Failed to intern a style"
+	);
+
+	return screen->amount_extras++;
+}
+
+/*
+ * Throw away all interned styles, except the default style at index 0.
+ * The cells in .front refer to the old styles, so the screen has to be
+ * completely redrawn afterwards.
+ */
+static void screen_reset_styles(wi_screen* screen) {
+	for (int i = 0; i < screen->amount_extras; i++) {
+		free(screen->extras[i]);
+	}
+	screen->amount_extras = 0;
+	screen->amount_styles = 0;
+	memset(screen->style_slots, 0, sizeof(screen->style_slots));
+	memset(screen->applied, 0, sizeof(screen->applied));
+	memset(screen->changes, 0, sizeof(screen->changes));
+	screen_intern_extra(screen, "", 0);
+	screen_intern_style(screen, &default_style);
+	screen->valid = false;
+}
+
+/*
+ * Read the SGR-parameter at `*i` as a number and move past it.
+ *
+ * @returns: the number, -1 when there is no parameter left or it's not a
+ *           plain number (like "4:3")
+ */
+static int next_sgr_parameter(
+	const char* parameters, const size_t length, size_t* i
+) {
+	if (*i > length) {
+		return -1;
+	}
+	int value = 0;
+	bool number = true;
+	while (*i < length && parameters[*i] != ';') {
+		if (parameters[*i] >= '0' && parameters[*i] <= '9') {
+			if (value < 100000) {
+				value = value * 10 + (parameters[*i] - '0');
+			}
+		} else {
+			number = false;
+		}
+		(*i)++;
+	}
+	(*i)++; /* The ';', or past the end */
+	return number ? value : -1;
+}
+
+/*
+ * Add parameters the style can't tell apart to the ones it already has.
+ *
+ * @returns: false when there are too many different ones to intern
+ */
+static bool add_extra_parameters(
+	wi_screen* screen, wi_style* style, const char* parameters, const size_t length
+) {
+	wi_frame_buffer extra = { .data = NULL, .length = 0, .capacity = 0 };
+	fb_append_string(&extra, screen->extras[style->extra]);
+	if (extra.length > 0) {
+		fb_append_char(&extra, ';');
+	}
+	fb_append(&extra, parameters, length);
+	const int index = screen_intern_extra(screen, extra.data, extra.length);
+	free(extra.data);
+	if (index < 0) {
+		return false;
+	}
+	style->extra = index;
+	return true;
+}
+
+/*
+ * Update `style` with the parameters of an SGR-sequence, the part between
+ * "\033[" and "m".
+ *
+ * @returns: false when its extra parameters can't be interned
+ */
+static bool apply_sgr(
+	wi_screen* screen, wi_style* style, const char* parameters, const size_t length
+) {
+	size_t i = 0;
+	while (i <= length) {
+		const size_t start = i;
+		const int parameter = next_sgr_parameter(parameters, length, &i);
+
+		if (parameter == 0) {
+			*style = default_style;
+		} else if (parameter == 4) {
+			style->underline = 1;
+		} else if (parameter == 21) {
+			style->underline = 2;
+		} else if (parameter == 24) {
+			style->underline = 0;
+		} else if (
+			parameter < 0 && i - 1 - start == 3 && parameters[start] == '4'
+			&& parameters[start + 1] == ':' && parameters[start + 2] <= '5'
+			&& parameters[start + 2] >= '0'
+		) {
+			/* "4:0" turns underlining off, "4:1" and "4:2" are "4" and "21" */
+			style->underline = parameters[start + 2] - '0';
+		} else if (parameter >= 1 && parameter <= 9) {
+			style->effects |= WI_EFFECT(parameter);
+		} else if (parameter == 22) {
+			style->effects &= ~(WI_EFFECT(1) | WI_EFFECT(2));
+		} else if (parameter == 25) {
+			style->effects &= ~(WI_EFFECT(5) | WI_EFFECT(6));
+		} else if (parameter >= 23 && parameter <= 29 && parameter != 26) {
+			style->effects &= ~WI_EFFECT(parameter - 20);
+		} else if (parameter >= 30 && parameter <= 37) {
+			style->foreground = WI_COLOUR_BASIC | (parameter - 30);
+		} else if (parameter >= 90 && parameter <= 97) {
+			style->foreground = WI_COLOUR_BASIC | (parameter - 90 + 8);
+		} else if (parameter == 39) {
+			style->foreground = 0;
+		} else if (parameter >= 40 && parameter <= 47) {
+			style->background = WI_COLOUR_BASIC | (parameter - 40);
+		} else if (parameter >= 100 && parameter <= 107) {
+			style->background = WI_COLOUR_BASIC | (parameter - 100 + 8);
+		} else if (parameter == 49) {
+			style->background = 0;
+		} else if (parameter == 38 || parameter == 48) {
+			/* "38;5;<index>" or "38;2;<r>;<g>;<b>" */
+			unsigned int colour = 0;
+			const int kind = next_sgr_parameter(parameters, length, &i);
+			if (kind == 5) {
+				const int index = next_sgr_parameter(parameters, length, &i);
+				if (index >= 0 && index <= 255) {
+					colour = WI_COLOUR_INDEXED | index;
+				}
+			} else if (kind == 2) {
+				colour = WI_COLOUR_RGB;
+				for (int shift = 16; shift >= 0 && colour != 0; shift -= 8) {
+					const int part = next_sgr_parameter(parameters, length, &i);
+					colour = part >= 0 && part <= 255 ? colour | part << shift : 0;
+				}
+			}
+
+			if (colour == 0) {
+				if (!add_extra_parameters(
+					screen, style, parameters + start, i - 1 - start
+				)) {
+					return false;
+				}
+			} else if (parameter == 38) {
+				style->foreground = colour;
+			} else {
+				style->background = colour;
+			}
+		} else if (!add_extra_parameters(
+			screen, style, parameters + start, i - 1 - start
+		)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Append an SGR-parameter, after a ';' when it's not the first since `start` */
+static inline void append_sgr_parameter(
+	wi_frame_buffer* fb, const size_t start, const unsigned int parameter
+) {
+	if (fb->length > start) {
+		fb_append_char(fb, ';');
+	}
+	fb_append_uint(fb, parameter);
+}
+
+/* Append the parameters for a colour, `base` is 30 for the foreground */
+static void append_sgr_colour(
+	wi_frame_buffer* fb, const size_t start, const unsigned int colour,
+	const unsigned int base
+) {
+	switch (colour & WI_COLOUR_KIND) {
+		case WI_COLOUR_BASIC:
+			append_sgr_parameter(
+				fb, start, (colour & 0xFF) < 8
+					? base + (colour & 0xFF) : base + 60 + (colour & 0xFF) - 8
+			);
+			break;
+		case WI_COLOUR_INDEXED:
+			append_sgr_parameter(fb, start, base + 8);
+			append_sgr_parameter(fb, start, 5);
+			append_sgr_parameter(fb, start, colour & 0xFF);
+			break;
+		case WI_COLOUR_RGB:
+			append_sgr_parameter(fb, start, base + 8);
+			append_sgr_parameter(fb, start, 2);
+			append_sgr_parameter(fb, start, (colour >> 16) & 0xFF);
+			append_sgr_parameter(fb, start, (colour >> 8) & 0xFF);
+			append_sgr_parameter(fb, start, colour & 0xFF);
+			break;
+		default:
+			append_sgr_parameter(fb, start, base + 9);
+			break;
+	}
+}
+
+/*
+ * Append the parameters that turn style `from` into style `to`.
+ * Unknown parameters of `from` can't be turned off, so they have to be the
+ * same as those of `to`, or empty.
+ */
+static void append_style_differences(
+	wi_frame_buffer* fb, const wi_screen* screen,
+	const wi_style* from, const wi_style* to
+) {
+	const size_t start = fb->length;
+	unsigned int off = from->effects & ~to->effects;
+	unsigned int on = to->effects & ~from->effects;
+
+	/* 22 and 25 turn off two effects at once, one may have to come back */
+	if (off & (WI_EFFECT(1) | WI_EFFECT(2))) {
+		append_sgr_parameter(fb, start, 22);
+		on |= to->effects & (WI_EFFECT(1) | WI_EFFECT(2));
+	}
+	if (off & (WI_EFFECT(5) | WI_EFFECT(6))) {
+		append_sgr_parameter(fb, start, 25);
+		on |= to->effects & (WI_EFFECT(5) | WI_EFFECT(6));
+	}
+	for (int effect = 3; effect <= 9; effect++) {
+		if (effect != 5 && effect != 6 && (off & WI_EFFECT(effect))) {
+			append_sgr_parameter(fb, start, 20 + effect);
+		}
+	}
+	for (int effect = 1; effect <= 9; effect++) {
+		if (on & WI_EFFECT(effect)) {
+			append_sgr_parameter(fb, start, effect);
+		}
+	}
+
+	if (from->underline != to->underline) {
+		if (to->underline <= 2) {
+			append_sgr_parameter(fb, start, (unsigned int[]) { 24, 4, 21 }[to->underline]);
+		} else {
+			append_sgr_parameter(fb, start, 4);
+			fb_append_char(fb, ':');
+			fb_append_uint(fb, to->underline);
+		}
+	}
+
+	if (from->foreground != to->foreground) {
+		append_sgr_colour(fb, start, to->foreground, 30);
+	}
+	if (from->background != to->background) {
+		append_sgr_colour(fb, start, to->background, 40);
+	}
+	if (from->extra != to->extra) {
+		if (fb->length > start) {
+			fb_append_char(fb, ';');
+		}
+		fb_append_string(fb, screen->extras[to->extra]);
+	}
+}
+
+/*
+ * Append the SGR-sequence that takes the terminal from one interned style
+ * to another: only what differs, or a reset followed by all of the new
+ * style, whichever is shorter.
+ */
+static void append_style_change(
+	wi_frame_buffer* fb, const wi_screen* screen,
+	const unsigned short from_index, const unsigned short to_index
+) {
+	if (from_index == to_index) {
+		return;
+	}
+	const wi_style* from = &(screen->styles[from_index]);
+	const wi_style* to = &(screen->styles[to_index]);
+
+	fb_append(fb, "\033[", 2);
+	const size_t start = fb->length;
+	size_t changed_length = SIZE_MAX;
+	if (from->extra == 0 || from->extra == to->extra) {
+		append_style_differences(fb, screen, from, to);
+		changed_length = fb->length - start;
+	}
+
+	const size_t reset_start = fb->length;
+	fb_append_char(fb, '0');
+	if (to_index != 0) {
+		fb_append_char(fb, ';');
+		append_style_differences(fb, screen, &default_style, to);
+	}
+	const size_t reset_length = fb->length - reset_start;
+
+	if (reset_length < changed_length) {
+		memmove(fb->data + start, fb->data + reset_start, reset_length);
+		fb->length = start + reset_length;
+	} else {
+		fb->length = reset_start;
+	}
+	fb_append_char(fb, 'm');
+}
+
+/*
+ * The style an SGR-sequence (including "\033[" and "m") takes an interned
+ * style to, interning that one too.
+ *
+ * @returns: index of the new style, -1 when it can't be interned
+ */
+static int screen_apply_sgr(
+	wi_screen* screen, const unsigned short from,
+	const char* sequence, const size_t length
+) {
+	/* Resetting is by far the most common */
+	if (length == 3 || (length == 4 && sequence[2] == '0')) {
+		return 0;
+	}
+
+	uint64_t hash = from;
+	for (size_t i = 0; i < length; i += sizeof(uint64_t)) {
+		uint64_t word = 0;
+		memcpy(&word, sequence + i, length - i < sizeof(word) ? length - i : sizeof(word));
+		hash = (hash ^ word) * 0x9E3779B97F4A7C15u;
+	}
+	wi_style_step* step = &(screen->applied[(hash >> 32) % WI_STYLE_STEPS]);
+	if (
+		step->length == length && step->from == from
+		&& memcmp(step->sequence, sequence, length) == 0
+	) {
+		return step->to;
+	}
+
+	wi_style style = screen->styles[from];
+	if (!apply_sgr(screen, &style, sequence + 2, length - 3)) {
+		return -1;
+	}
+	const int to = screen_intern_style(screen, &style);
+
+	if (to >= 0 && length <= WI_STYLE_STEP_BYTES) {
+		step->from = from;
+		step->to = to;
+		step->length = length;
+		memcpy(step->sequence, sequence, length);
+	}
+	return to;
+}
+
+/* Same as `append_style_change()`, but remembers what it appended */
+static void screen_change_style(
+	wi_frame_buffer* fb, wi_screen* screen,
+	const unsigned short from, const unsigned short to
+) {
+	if (from == to) {
+		return;
+	}
+	wi_style_step* step =
+		&(screen->changes[((unsigned int) from * 97 + to) % WI_STYLE_STEPS]);
+	if (step->length > 0 && step->from == from && step->to == to) {
+		fb_append(fb, step->sequence, step->length);
+		return;
+	}
+
+	const size_t start = fb->length;
+	append_style_change(fb, screen, from, to);
+	const size_t length = fb->length - start;
+	if (length <= WI_STYLE_STEP_BYTES) {
+		step->from = from;
+		step->to = to;
+		step->length = length;
+		memcpy(step->sequence, fb->data + start, length);
+	}
+}
+
+/*
+ * Rewrite the markup of the frame in the frame-buffer: all SGR-sequences
+ * between two pieces of text become the one sequence that takes the
+ * terminal from the style it's in to the style the text is drawn in, if
+ * it needs one at all. Assumes the terminal starts in the default style,
+ * and leaves it in there.
+ */
+static void compact_frame_styles(wi_session* session) {
+	wi_frame_buffer* frame = &(session->internal.frame);
+	wi_frame_buffer* compacted = &(session->internal.compacted_frame);
+	wi_screen* screen = &(session->internal.screen);
+
+	/* A diffed frame checks the styles itself, its cells refer to them */
+	if (
+		screen->amount_styles == 0
+		|| (!session->diff_rendering && screen->amount_styles >= WI_SCREEN_MAX_STYLES)
+	) {
+		screen_reset_styles(screen);
+	}
+
+	compacted->length = 0;
+	fb_reserve(compacted, frame->length);
+
+	const char* data = frame->data;
+	const size_t length = frame->length;
+	int current = 0;
+	int pending = 0;
+	/* Past the styles the screen can intern, the markup is left alone */
+	bool passed_through = false;
+
+	/* Everything from `copied` up to `i` goes out as it is, in one go */
+	size_t copied = 0;
+	size_t i = 0;
+	while (i < length) {
+		if (data[i] == '\033' && i + 1 < length && data[i + 1] == '[') {
+			size_t end = i + 2;
+			while (end < length && data[end] >= 0x20 && data[end] <= 0x3F) {
+				end++;
+			}
+			if (end >= length) {
+				break;
+			}
+
+			if (data[end] == 'm') {
+				fb_append(compacted, data + copied, i - copied);
+				copied = i;
+				const int next = screen_apply_sgr(screen, pending, data + i, end + 1 - i);
+				if (next < 0) {
+					screen_change_style(compacted, screen, current, pending);
+					passed_through = true;
+					break;
+				}
+				pending = next;
+				i = end + 1;
+				copied = i;
+				continue;
+			}
+			/* Clearing fills with the background-colour */
+			if ((data[end] == 'J' || data[end] == 'K') && pending != current) {
+				fb_append(compacted, data + copied, i - copied);
+				copied = i;
+				screen_change_style(compacted, screen, current, pending);
+				current = pending;
+			}
+			i = end + 1;
+			continue;
+		}
+
+		/* Text up to the next escape-sequence. Newlines and the like in
+		 * front of it don't care about the markup */
+		const char* escape = memchr(data + i + 1, '\033', length - i - 1);
+		const size_t end = escape == NULL ? length : (size_t) (escape - data);
+		if (pending != current) {
+			while (i < end && (unsigned char) data[i] < 0x20 && data[i] != '\033') {
+				i++;
+			}
+			if (i < end) {
+				fb_append(compacted, data + copied, i - copied);
+				copied = i;
+				screen_change_style(compacted, screen, current, pending);
+				current = pending;
+			}
+		}
+		i = end;
+	}
+	fb_append(compacted, data + copied, length - copied);
+
+	if (passed_through) {
+		fb_append_string(compacted, "\033[0m");
+	} else {
+		screen_change_style(compacted, screen, current, 0);
+	}
+
+	wi_frame_buffer temp = *frame;
+	*frame = *compacted;
+	*compacted = temp;
+}
+
+int wi_render_frame(wi_session* session) {
+	wi_frame_buffer* fb = &(session->internal.frame);
+
+	/* Anything already in the buffer (like clearing the screen) goes out
+	 * together with this frame. */
+	lock_content(session);
+	int height = render_session(fb, session);
+	compact_frame_styles(session);
+	unlock_content(session);
+	fb_flush(fb);
+
+	return height;
+}
+
+static const wi_cell blank_cell = { .glyph = { ' ' }, .bytes = 1, .style = 0 };
+
+/*
+ * Make the screen-model the given size.
+ * The old content is of no use anymore, so the screen gets invalidated.
+ */
+static void screen_resize(wi_screen* screen, const terminal_size size) {
+	const size_t amount_cells = (size_t) size.rows * size.cols;
+
+	screen->front = (wi_cell*) realloc(
+		screen->front, (amount_cells + 1) * sizeof(wi_cell)
+	);
+	screen->back = (wi_cell*) realloc(
+		screen->back, (amount_cells + 1) * sizeof(wi_cell)
+	);
+	wiAssertCallback(
+		screen->front != NULL && screen->back != NULL, restore_terminal(),
+		"Failed to allocate the screen-model"
+	);
+
+	screen->rows = size.rows;
+	screen->cols = size.cols;
+	screen->valid = false;
+}
+
+/*
+ * Update the back-grid of the screen with what the terminal would show
+ * after receiving `stream`, which is assumed to start with the cursor on
+ * the top-left cell of the screen.
+ * Only understands what the renderer itself emits: text, newlines,
+ * carriage-returns, cursor-movements, clearing and SGR-sequences.
+ * Anything outside the screen is ignored.
+ *
+ * @returns: false when it has more styles than the screen can intern, the
+ *           back-grid is of no use then
+ */
+static bool screen_apply(
+	wi_screen* screen, const char* stream, const size_t length
+) {
+	int row = 0;
+	int col = 0;
+	int style = 0;
+
+	size_t i = 0;
+	while (i < length) {
+		const unsigned char c = stream[i];
+
+		if (c == '\n') {
+			row++;
+			col = 0;
+			i++;
+
+		} else if (c == '\r') {
+			col = 0;
+			i++;
+
+		} else if (c == '\033' && i + 1 < length && stream[i + 1] == '[') {
+			const size_t start = i;
+			unsigned int params[2] = { 0, 0 };
+			int param = 0;
+
+			i += 2;
+			/* Parameters like ':' (in "\033[4:3m") are only skipped */
+			while (i < length && stream[i] >= 0x20 && stream[i] <= 0x3F) {
+				if (stream[i] == ';') {
+					param++;
+				} else if (param < 2 && stream[i] >= '0' && stream[i] <= '9') {
+					params[param] = params[param] * 10 + (stream[i] - '0');
+				}
+				i++;
+			}
+			if (i >= length) {
+				break;
+			}
+
+			const char final = stream[i];
+			const int amount = params[0] == 0 ? 1 : params[0];
+			i++;
+
+			switch (final) {
+				case 'A': row -= amount; break;
+				case 'B': row += amount; break;
+				case 'C': col += amount; break;
+				case 'D': col -= amount; break;
+
+				case 'H':
+					row = amount - 1;
+					col = (params[1] == 0 ? 1 : params[1]) - 1;
+					break;
+
+				case 'J':
+					for (int j = 0; j < screen->rows * screen->cols; j++) {
+						screen->back[j] = blank_cell;
+					}
+					break;
+
+				case 'K':
+					if (row >= 0 && row < screen->rows) {
+						for (int j = 0; j < screen->cols; j++) {
+							screen->back[row * screen->cols + j] = blank_cell;
+						}
+					}
+					break;
+
+				case 'm':
+					style = screen_apply_sgr(screen, style, stream + start, i - start);
+					if (style < 0) {
+						return false;
+					}
+					break;
+
+				default:
+					break;
+			}
+
+			if (row < 0) row = 0;
+			if (col < 0) col = 0;
+
+		} else if (c == '\033') {
+			i += 2;
+
+		} else {
+			size_t bytes = 1;
+			if ((c & 0xF0) == 0xF0) {
+				bytes = 4;
+			} else if ((c & 0xE0) == 0xE0) {
+				bytes = 3;
+			} else if ((c & 0xC0) == 0xC0) {
+				bytes = 2;
+			}
+			int width = 1;
+			if (bytes > length - i) {
+				bytes = length - i;
+			} else if (bytes > 1) {
+				width = wi_char_byte_size(stream + i).width;
+			}
+
+			if (width == 0) {
+				/* Combining characters go on the cell before them, as long
+				 * as there's room */
+				if (row < screen->rows && col > 0 && col <= screen->cols) {
+					wi_cell* cell = &(screen->back[row * screen->cols + col - 1]);
+					if (cell->bytes == 0 && col > 1) {
+						cell--;
+					}
+					if (cell->bytes + bytes <= sizeof(cell->glyph)) {
+						memcpy(cell->glyph + cell->bytes, stream + i, bytes);
+						cell->bytes += bytes;
+					}
+				}
+				i += bytes;
+				continue;
+			}
+
+			if (row < screen->rows && col < screen->cols) {
+				wi_cell* cell = &(screen->back[row * screen->cols + col]);
+				memcpy(cell->glyph, stream + i, bytes);
+				cell->bytes = bytes;
+				cell->style = style;
+			}
+			if (width == 2 && row < screen->rows && col + 1 < screen->cols) {
+				/* The second cell of a wide character stays empty */
+				wi_cell* cell = &(screen->back[row * screen->cols + col + 1]);
+				cell->bytes = 0;
+				cell->style = style;
+			}
+			col += width;
+			i += bytes;
+		}
+	}
+	return true;
+}
+
+static inline bool cells_equal(const wi_cell* a, const wi_cell* b) {
+	return a->bytes == b->bytes && a->style == b->style
+		&& memcmp(a->glyph, b->glyph, a->bytes) == 0;
+}
+
+/*
+ * Move the cursor between two cells of the screen with relative movements.
+ * A column of -1 means that the column of the cursor is not known, which
+ * happens after writing in the last column of the terminal.
+ */
+static void screen_move_cursor(
+	wi_frame_buffer* fb, int* row, int* col, const int to_row, const int to_col
+) {
+	if (to_row < *row) {
+		cursor_move_up(fb, *row - to_row);
+	} else {
+		cursor_move_down(fb, to_row - *row);
+	}
+
+	if (*col < 0 || (to_col == 0 && *col != 0)) {
+		fb_append_char(fb, '\r');
+		*col = 0;
+	}
+	if (to_col > *col) {
+		cursor_move_right(fb, to_col - *col);
+	} else {
+		cursor_move_left(fb, *col - to_col);
+	}
+
+	*row = to_row;
+	*col = to_col;
+}
+
+/*
+ * Append only the cells that differ between the front- and back-grid,
+ * jumping between them with the cursor.
+ * Assumes the cursor starts on the first row below the screen, in the first
+ * column, and leaves it there again.
+ */
+static void screen_emit_diff(wi_screen* screen, wi_frame_buffer* fb) {
+	int cursor_row = screen->rows;
+	int cursor_col = 0;
+	/* Every frame leaves the terminal in the default style */
+	int current_style = 0;
+
+	for (int row = 0; row < screen->rows; row++) {
+		for (int col = 0; col < screen->cols; col++) {
+			const int index = row * screen->cols + col;
+			const wi_cell* cell = &(screen->back[index]);
+			if (cell->bytes == 0) {
+				/* Written along with the first cell of the wide character */
+				continue;
+			}
+			const bool wide =
+				col + 1 < screen->cols && screen->back[index + 1].bytes == 0;
+			if (
+				cells_equal(cell, &(screen->front[index]))
+				&& (!wide || cells_equal(cell + 1, &(screen->front[index + 1])))
+			) {
+				continue;
+			}
+
+			/* A few cells in between are cheaper to rewrite then to jump
+			 * over, as long as no style has to be switched for them */
+			bool rewrite_gap =
+				row == cursor_row && col > cursor_col && col - cursor_col <= 4;
+			for (int gap = cursor_col; rewrite_gap && gap < col; gap++) {
+				rewrite_gap =
+					screen->back[row * screen->cols + gap].style == current_style;
+			}
+
+			if (rewrite_gap) {
+				for (; cursor_col < col; cursor_col++) {
+					const wi_cell* gap_cell =
+						&(screen->back[row * screen->cols + cursor_col]);
+					fb_append(fb, gap_cell->glyph, gap_cell->bytes);
+				}
+			} else {
+				screen_move_cursor(fb, &cursor_row, &cursor_col, row, col);
+			}
+
+			if (cell->style != current_style) {
+				screen_change_style(fb, screen, current_style, cell->style);
+				current_style = cell->style;
+			}
+			fb_append(fb, cell->glyph, cell->bytes);
+
+			cursor_col += wide ? 2 : 1;
+			if (cursor_col >= screen->cols) {
+				cursor_col = -1;
+			}
+		}
+	}
+
+	if (current_style > 0) {
+		fb_append_string(fb, "\033[0m");
+	}
+	screen_move_cursor(fb, &cursor_row, &cursor_col, screen->rows, 0);
+}
+
+/*
+ * Scrolling a region costs about this many bytes, it's only done when it
+ * saves more cells then that from being rewritten
+ */
+#define WI_SCROLL_REGION_COST 32
+
+/* Tells rows of cells apart, the way `cells_equal()` does */
+static uint64_t screen_row_hash(const wi_cell* cells, const int amount) {
+	uint64_t hash = 0xCBF29CE484222325u;
+	for (int i = 0; i < amount; i++) {
+		hash = (hash ^ cells[i].style ^ ((uint64_t) cells[i].bytes << 16))
+			* 0x100000001B3u;
+		for (int j = 0; j < cells[i].bytes; j++) {
+			hash = (hash ^ (unsigned char) cells[i].glyph[j]) * 0x100000001B3u;
+		}
+	}
+	return hash;
+}
+
+/*
+ * When the rows `top` to `bottom` (columns `left` to `right`) of the back-grid
+ * are mostly the rows of the front-grid moved up or down, let the terminal
+ * move them with a scroll-region, and move them in the front-grid as well.
+ * The diff that follows then only has to write the rows that came into view,
+ * and whatever else changed.
+ * Rows and columns are those of the screen, which has to start at the top-
+ * left of the terminal. Without `margins`, the region has to span the width
+ * of the screen.
+ */
+static void screen_scroll_region(
+	wi_screen* screen, wi_frame_buffer* fb, const int top, const int bottom,
+	const int left, const int right, const bool margins
+) {
+	const int height = bottom - top + 1;
+	const int width = right - left + 1;
+	if (height < 2) {
+		return;
+	}
+
+	uint64_t front_hashes[height];
+	uint64_t back_hashes[height];
+	int unchanged = 0;
+	for (int i = 0; i < height; i++) {
+		const int index = (top + i) * screen->cols + left;
+		front_hashes[i] = screen_row_hash(screen->front + index, width);
+		back_hashes[i] = screen_row_hash(screen->back + index, width);
+		if (front_hashes[i] == back_hashes[i]) {
+			unchanged++;
+		}
+	}
+	if (unchanged == height) {
+		return;
+	}
+
+	/* Positive when the rows moved up, like scrolling down through content */
+	int best_shift = 0;
+	int best_matches = unchanged;
+	for (int shift = 1 - height; shift < height; shift++) {
+		if (shift == 0) {
+			continue;
+		}
+		int matches = 0;
+		const int first = shift > 0 ? 0 : -shift;
+		for (int i = first; i < height && i + shift < height; i++) {
+			if (back_hashes[i] == front_hashes[i + shift]) {
+				matches++;
+			}
+		}
+		if (matches > best_matches) {
+			best_shift = shift;
+			best_matches = matches;
+		}
+	}
+	if ((best_matches - unchanged) * width <= WI_SCROLL_REGION_COST) {
+		return;
+	}
+
+	const int distance = best_shift > 0 ? best_shift : -best_shift;
+
+	/* The cursor and style get saved, as setting the region moves the
+	 * cursor to the top-left of the terminal */
+	fb_append_string(fb, "\0337");
+	if (margins) {
+		fb_append_string(fb, "\033[?69h\033[");
+		fb_append_uint(fb, left + 1);
+		fb_append_char(fb, ';');
+		fb_append_uint(fb, right + 1);
+		fb_append_char(fb, 's');
+	}
+	fb_append(fb, "\033[", 2);
+	fb_append_uint(fb, top + 1);
+	fb_append_char(fb, ';');
+	fb_append_uint(fb, bottom + 1);
+	fb_append_char(fb, 'r');
+	cursor_move(fb, distance, best_shift > 0 ? 'S' : 'T');
+	fb_append_string(fb, "\033[r");
+	if (margins) {
+		fb_append_string(fb, "\033[?69l");
+	}
+	fb_append_string(fb, "\0338");
+
+	/* The rows that came into view are blank on the terminal */
+	for (int i = 0; i < height; i++) {
+		const int row = best_shift > 0 ? top + i : bottom - i;
+		wi_cell* cells = screen->front + row * screen->cols + left;
+		if (i < height - distance) {
+			memcpy(
+				cells, cells + best_shift * screen->cols,
+				(size_t) width * sizeof(wi_cell)
+			);
+		} else {
+			for (int col = 0; col < width; col++) {
+				cells[col] = blank_cell;
+			}
+		}
+	}
+}
+
+/*
+ * Scroll the content of the windows that moved up or down on the screen,
+ * see `screen_scroll_region()`. Without `.scroll_margins` a window can only
+ * be scrolled together with everything next to it.
+ */
+static void screen_scroll_windows(wi_session* session, wi_frame_buffer* fb) {
+	wi_screen* screen = &(session->internal.screen);
+	int accumulated_height = 0;
+
+	for (int row = 0; row < session->internal.amount_rows; row++) {
+		int accumulated_row_width = 0;
+		int max_row_height = 0;
+
+		for (int col = 0; col < session->internal.amount_cols[row]; col++) {
+			const wi_window* window = session->windows[row][col];
+			const int top =
+				accumulated_height + (window->border.side_top != NULL ? 1 : 0);
+			const int bottom = top + window->internal.rendered_height - 1;
+			const int left = session->scroll_margins ? accumulated_row_width : 0;
+			const int right = session->scroll_margins
+				? accumulated_row_width + window_printed_width(window) - 1
+				: screen->cols - 1;
+
+			if (bottom < screen->rows && right < screen->cols) {
+				screen_scroll_region(
+					screen, fb, top, bottom, left, right, session->scroll_margins
+				);
+			}
+
+			accumulated_row_width += window_printed_width(window);
+			if (window_printed_height(window) > max_row_height) {
+				max_row_height = window_printed_height(window);
+			}
+		}
+
+		accumulated_height += max_row_height;
+	}
+}
+
+/*
+ * Render a frame through the screen-model: the frame is rendered as usual,
+ * but only the cells that differ from what is on the terminal are written.
+ * When the screen-model is out of date (first frame, resizing, ...) the
+ * whole frame is written like `wi_render_frame()` would.
+ * The frame is left in the frame-buffer, for the caller to flush.
+ *
+ * @returns: height of the frame.
+ */
+int render_diffed_frame(
+	wi_session* session, const bool dimensions_changed, const int printed_height
+) {
+	wi_frame_buffer* fb = &(session->internal.frame);
+	wi_screen* screen = &(session->internal.screen);
+	const terminal_size size = frame_size(session);
+	const size_t start = fb->length;
+
+	if (
+		dimensions_changed || screen->front == NULL
+		|| size.rows != screen->rows || size.cols != screen->cols
+	) {
+		screen_resize(screen, size);
+	}
+	if (screen->amount_styles == 0 || screen->amount_styles >= WI_SCREEN_MAX_STYLES) {
+		screen_reset_styles(screen);
+	}
+
+	const bool full_frame = !screen->valid;
+	if (full_frame) {
+		mark_session_dirty(session);
+		if (session->start_clear_screen || dimensions_changed) {
+			clear_screen(fb);
+		} else {
+			cursor_move_up(fb, printed_height);
+		}
+		for (int i = 0; i < screen->rows * screen->cols; i++) {
+			screen->back[i] = blank_cell;
+		}
+	} else {
+		memcpy(
+			screen->back, screen->front,
+			(size_t) screen->rows * screen->cols * sizeof(wi_cell)
+		);
+	}
+
+	const size_t frame_start = fb->length;
+	const int height = render_session(fb, session);
+	const bool applied =
+		screen_apply(screen, fb->data + frame_start, fb->length - frame_start);
+
+	/* With too many styles to diff, the whole frame goes out with its markup
+	 * as it is, and so does the next one */
+	if (!applied && !full_frame) {
+		fb->length = start;
+		screen_reset_styles(screen);
+		return render_diffed_frame(session, dimensions_changed, printed_height);
+	}
+
+	if (full_frame) {
+		compact_frame_styles(session);
+	} else {
+		fb->length = 0;
+		/* Scroll-regions need to know where the screen is on the terminal */
+		if (
+			session->start_clear_screen
+			&& session->internal.frame_windows_redrawn > 0
+		) {
+			screen_scroll_windows(session, fb);
+		}
+		screen_emit_diff(screen, fb);
+	}
+
+	wi_cell* temp = screen->front;
+	screen->front = screen->back;
+	screen->back = temp;
+	screen->valid = applied;
+
+	return height;
+}
+
+size_t wi_render_frame_to_buffer(
+	wi_session* session, const int rows, const int cols,
+	char* buffer, const size_t buffer_size
+) {
+	wi_frame_buffer* fb = &(session->internal.frame);
+	const bool first_frame = session->internal.terminal_cols == 0;
+	lock_content(session);
+
+	const bool dimensions_changed =
+		apply_terminal_size(session, (terminal_size) { rows, cols });
+	if (first_frame) {
+		update_wrapped_windows(session);
+	}
+
+	if (session->diff_rendering) {
+		render_diffed_frame(session, dimensions_changed, 0);
+	} else {
+		if (dimensions_changed) {
+			mark_session_dirty(session);
+		}
+		render_session(fb, session);
+		compact_frame_styles(session);
+	}
+	unlock_content(session);
+
+	const size_t length = fb->length;
+	if (buffer_size > 0) {
+		const size_t copied = length < buffer_size ? length : buffer_size - 1;
+		memcpy(buffer, fb->data, copied);
+		buffer[copied] = '\0';
+	}
+	fb->length = 0;
+
+	return length;
+}
+
+void wake_render_thread(wi_session* session) {
+	const int fd = session->internal.render_wake_pipe[1];
+	if (fd >= 0) {
+		/* When the pipe is full, a wake-up is pending anyway */
+		ssize_t _ = write(fd, "", 1);
+		(void)(_);
+	}
+}
+
+void request_rerender(wi_session* session) {
+	atomic_store(&(session->need_rerender), true);
+	wake_render_thread(session);
+}
+
+long long monotonic_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/*
+ * Block until the render-thread gets woken up, or until `timeout_ms` passed.
+ * A timeout of -1 waits indefinitely.
+ * All pending wake-ups are consumed, because the reasons for them are kept
+ * in the session itself (`.need_rerender`, `.keep_running`).
+ */
+static void wait_for_render_event(wi_session* session, const int timeout_ms) {
+	struct pollfd wake = {
+		.fd = session->internal.render_wake_pipe[0], .events = POLLIN
+	};
+
+	/* Interrupted by a signal (EINTR) counts as woken up too */
+	if (poll(&wake, 1, timeout_ms) > 0) {
+		char drain[64];
+		while (read(wake.fd, drain, sizeof(drain)) > 0);
+	}
+}
+
+/*
+ * Wait until the frame-rate allows a new frame to be drawn.
+ * Everything that asks for a frame in the meantime gets bundled into that
+ * one frame.
+ */
+static void wait_for_frame_slot(wi_session* session, const long long last_frame) {
+	if (session->max_frame_rate <= 0) {
+		return;
+	}
+
+	const long long interval = 1000000000LL / session->max_frame_rate;
+	long long remaining = last_frame + interval - monotonic_ns();
+	while (remaining > 0 && session->keep_running) {
+		/* Round up, so this doesn't spin on the last millisecond */
+		wait_for_render_event(session, (remaining + 999999) / 1000000);
+		remaining = last_frame + interval - monotonic_ns();
+	}
+}
+
+/*
+ * Add the numbers of one frame to the statistics of the session.
+ * Times are in nanoseconds.
+ */
+static void record_frame_stats(
+	wi_session* session, const size_t bytes, const long long dimension_ns,
+	const long long render_ns, const long long write_ns
+) {
+	/* Every keypress until now is visible with this frame */
+	const long long pressed =
+		atomic_exchange(&(session->internal.pending_keypress_ns), 0);
+	const long long now = monotonic_ns();
+
+	mtx_lock(&(session->internal.stats_lock));
+	wi_stats* stats = &(session->internal.stats);
+
+	if (session->internal.frame_windows_redrawn == 0) {
+		stats->frames_skipped++;
+	} else {
+		stats->frames_rendered++;
+	}
+	stats->bytes_written += bytes;
+	stats->windows_redrawn += session->internal.frame_windows_redrawn;
+	stats->dimension_ns += dimension_ns;
+	stats->render_ns += render_ns;
+	stats->write_ns += write_ns;
+
+	if (pressed > 0) {
+		const long long latency = now - pressed;
+		stats->latency_samples++;
+		stats->last_latency_ns = latency;
+		stats->total_latency_ns += latency;
+		if (latency > stats->max_latency_ns) {
+			stats->max_latency_ns = latency;
+		}
+	}
+	mtx_unlock(&(session->internal.stats_lock));
+}
+
+wi_stats wi_get_stats(wi_session* session) {
+	mtx_lock(&(session->internal.stats_lock));
+	wi_stats snapshot = session->internal.stats;
+	mtx_unlock(&(session->internal.stats_lock));
+
+	return snapshot;
+}
+
+void wi_reset_stats(wi_session* session) {
+	mtx_lock(&(session->internal.stats_lock));
+	session->internal.stats = (wi_stats) { 0 };
+	mtx_unlock(&(session->internal.stats_lock));
+}
+
+/* Bytes of lazily split content to split at a time while idle */
+#define WI_IDLE_SPLIT_BYTES (1024 * 1024)
+
+typedef struct idle_split_task {
+	wi_window* window;
+	wi_content* content;
+} idle_split_task;
+
+static void idle_split(void* arg) {
+	idle_split_task* task = (idle_split_task*) arg;
+	if (!task->content->fully_split) {
+		continue_split_lines(task->content, INT_MAX, WI_IDLE_SPLIT_BYTES);
+	} else {
+		wrap_window_prefix(task->window, task->content, WI_IDLE_SPLIT_BYTES);
+	}
+}
+
+/*
+ * Split or wrap some more of the first contents of the session that aren't
+ * fully split or wrapped yet, so that it's done by the time they get
+ * scrolled to. One content per thread of the wrap-pool.
+ *
+ * @returns: whether there was content left to split
+ */
+static bool split_lazy_content(wi_session* session) {
+	wi_thread_pool* pool = session->internal.wrap_pool;
+	const int max_tasks = pool != NULL ? pool->amount_threads + 1 : 1;
+	idle_split_task tasks[max_tasks];
+	void* items[max_tasks];
+	int amount_tasks = 0;
+
+	lock_content(session);
+	for (int row = 0; row < session->internal.amount_rows; row++) {
+		for (int col = 0; col < session->internal.amount_cols[row]; col++) {
+			wi_window* window = session->windows[row][col];
+
+			for (int i = 0; i < window->internal.content_grid_row_capacity; i++) {
+				for (int j = 0; j < window->internal.content_grid_col_capacity[i]; j++) {
+					wi_content* content = &(window->content_grid[i][j]);
+					if (
+						amount_tasks == max_tasks
+						|| content->original.string == NULL
+						|| content->line_list == NULL
+						|| (content->fully_split && content->prefix == NULL)
+					) {
+						continue;
+					}
+
+					tasks[amount_tasks] = (idle_split_task) { window, content };
+					items[amount_tasks] = &(tasks[amount_tasks]);
+					amount_tasks++;
+				}
+			}
+		}
+	}
+	run_in_thread_pool(pool, idle_split, items, amount_tasks);
+	unlock_content(session);
+
+	return amount_tasks > 0;
+}
+
+int render_function(void* arg) {
+	wi_session* session = (wi_session*) arg;
+	wi_frame_buffer* fb = &(session->internal.frame);
+	int printed_height = 0;
+	long long last_frame = 0;
+
+	int wrap_threads = session->wrap_threads;
+	if (wrap_threads <= 0) {
+		wrap_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	session->internal.wrap_pool = make_thread_pool(wrap_threads - 1);
+
+	lock_content(session);
+	calculate_window_dimension(session);
+	atomic_store(&(session->need_rerender), true);
+	update_wrapped_windows(session);
+	unlock_content(session);
+
+	bool first_frame = true;
+	while (session->keep_running) {
+		/* Sleep until something happens that needs a new frame, or use the
+		 * time to split lazy content further */
+		if (!atomic_load(&(session->need_rerender))) {
+			const bool splitting = split_lazy_content(session);
+			wait_for_render_event(session, splitting ? 0 : -1);
+			continue;
+		}
+		wait_for_frame_slot(session, last_frame);
+		if (!session->keep_running) {
+			break;
+		}
+
+		const long long frame_start = monotonic_ns();
+		lock_content(session);
+		bool dimensions_changed = calculate_window_dimension(session);
+		const long long dimensions_done = monotonic_ns();
+		/* Cleared before rendering, so that requests made while rendering
+		 * are not lost */
+		atomic_store(&(session->need_rerender), false);
+
+		if (session->diff_rendering) {
+			printed_height = render_diffed_frame(
+				session, dimensions_changed, printed_height
+			);
+		} else {
+			if (first_frame || dimensions_changed) {
+				mark_session_dirty(session);
+			}
+
+			/* Only clear when everything gets redrawn anyway */
+			if (
+				dimensions_changed
+				|| (session->start_clear_screen && first_frame)
+			) {
+				clear_screen(fb);
+			} else if (session->start_clear_screen) {
+				cursor_go_to_row(fb, 1);
+			} else {
+				cursor_move_up(fb, printed_height);
+			}
+			printed_height = render_session(fb, session);
+			compact_frame_styles(session);
+		}
+		unlock_content(session);
+
+		const long long render_done = monotonic_ns();
+		const size_t bytes = fb->length;
+		fb_flush(fb);
+		last_frame = monotonic_ns();
+
+		if (session->collect_stats) {
+			record_frame_stats(
+				session, bytes, dimensions_done - frame_start,
+				render_done - dimensions_done, last_frame - render_done
+			);
+		}
+		first_frame = false;
+	}
+
+	free_thread_pool(session->internal.wrap_pool);
+	session->internal.wrap_pool = NULL;
+
+	return 0;
+}
+
+void handle_sigint(int _) {
+	(void)(_);
+	restore_terminal();
+	exit(0);
+}
+
+/* The sessions being shown, so the resize-handler knows who to wake up */
+#define WI_MAX_SHOWN_SESSIONS 16
+static _Atomic(wi_session*) shown_sessions[WI_MAX_SHOWN_SESSIONS];
+static atomic_int amount_shown_sessions = 0;
+static struct sigaction old_sigwinch;
+
+void handle_sigwinch(int _) {
+	(void)(_);
+	for (int i = 0; i < WI_MAX_SHOWN_SESSIONS; i++) {
+		wi_session* session = atomic_load(&(shown_sessions[i]));
+		if (session != NULL) {
+			atomic_store(&(session->internal.resize_pending), true);
+			request_rerender(session);
+		}
+	}
+}
+
+/*
+ * Make the resize-handler aware of the session. The handler is installed
+ * when the first session gets shown.
+ */
+static void register_shown_session(wi_session* session) {
+	bool registered = false;
+	for (int i = 0; i < WI_MAX_SHOWN_SESSIONS && !registered; i++) {
+		wi_session* empty = NULL;
+		registered = atomic_compare_exchange_strong(
+			&(shown_sessions[i]), &empty, session
+		);
+	}
+	wiAssert(registered, "Too many sessions are being shown at once");
+
+	if (atomic_fetch_add(&amount_shown_sessions, 1) == 0) {
+		struct sigaction sa_winch = { 0 };
+		sa_winch.sa_handler = handle_sigwinch;
+		sa_winch.sa_flags = SA_RESTART;
+		sigaction(SIGWINCH, &sa_winch, &old_sigwinch);
+	}
+}
+
+/*
+ * Opposite of `register_shown_session`, restores the old resize-handler when
+ * the last session stops being shown.
+ */
+static void unregister_shown_session(wi_session* session) {
+	if (atomic_fetch_sub(&amount_shown_sessions, 1) == 1) {
+		sigaction(SIGWINCH, &old_sigwinch, NULL);
+	}
+
+	for (int i = 0; i < WI_MAX_SHOWN_SESSIONS; i++) {
+		wi_session* expected = session;
+		if (atomic_compare_exchange_strong(&(shown_sessions[i]), &expected, NULL)) {
+			break;
+		}
+	}
+}
+
+/*
+ * Open a pipe that doesn't block on either end, and doesn't leak into
+ * child-processes.
+ */
+static void open_wake_pipe(int fds[2]) {
+	wiAssert(pipe(fds) == 0, "Failed to create a pipe to wake up threads");
+	for (int i = 0; i < 2; i++) {
+		fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+		fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+	}
+}
+
+static void close_wake_pipe(int fds[2]) {
+	close(fds[0]);
+	close(fds[1]);
+	fds[0] = -1;
+	fds[1] = -1;
+}
+
+void wi_show_session(wi_session* session) {
 	int focus_row = session->focus_pos.row;
 	int focus_col = session->focus_pos.col;
 	wiAssert(
@@ -512,6 +2456,12 @@ void wi_show_session(wi_session* session) {
 	sa.sa_handler = handle_sigint;
 	sigaction(SIGINT, &sa, NULL);
 
+	/* Redraw as soon as the terminal gets resized */
+	open_wake_pipe(session->internal.render_wake_pipe);
+	open_wake_pipe(session->internal.input_wake_pipe);
+	/* Always ask the terminal for its size at the first frame */
+	atomic_store(&(session->internal.resize_pending), true);
+	register_shown_session(session);
 
 	/* Initialise threading */
 	thrd_t render_thread, input_thread;
@@ -527,30 +2477,31 @@ void wi_show_session(wi_session* session) {
 	thrd_join(render_thread, NULL);
 	session->running_render_thread = false;
 	thrd_join(input_thread, NULL);
+
+	unregister_shown_session(session);
+	close_wake_pipe(session->internal.render_wake_pipe);
+	close_wake_pipe(session->internal.input_wake_pipe);
 }
 
 void wi_clear_screen_afterwards(wi_session* session) {
+	wi_frame_buffer* fb = &(session->internal.frame);
+
 	for (int i = session->internal.amount_rows - 1; i >= 0; i--) {
 		/* Determine highest window in the row */
 		int row_height = 0;
 		for (int j = 0; j < session->internal.amount_cols[i]; j++) {
-			int height = session->windows[i][j]->internal.rendered_height;
-			if (session->windows[i][j]->border.side_bottom != NULL) {
-				height++;
-			}
-			if (session->windows[i][j]->border.side_top != NULL) {
-				height++;
-			}
-
+			int height = window_printed_height(session->windows[i][j]);
 			if (height > row_height) {
 				row_height = height;
 			}
 		}
 
 		while (row_height > 0) {
-			cursor_move_up(1);
-			printf("\033[2K");
+			cursor_move_up(fb, 1);
+			fb_append_string(fb, "\033[2K");
 			row_height--;
 		}
 	}
+
+	fb_flush(fb);
 }
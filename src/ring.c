@@ -0,0 +1,112 @@
+#define _GNU_SOURCE			/* memfd_create() */
+
+#include <errno.h>		/* errno, EINVAL */
+#include <limits.h>		/* INT_MAX */
+#include <stdlib.h>		/* malloc(), free() */
+#include <sys/mman.h>	/* mmap(), munmap(), memfd_create() */
+#include <unistd.h>		/* ftruncate(), close(), sysconf() */
+
+#include "wi_internals.h"
+#include "wi_data.h"
+
+/*
+ * Splitting can get this many lines further than it was asked for, as it
+ * goes through a whole chunk of bytes at once.
+ */
+#define WI_RING_LINE_SLACK 64
+
+/*
+ * Map `size` bytes twice in a row, so that the second mapping continues
+ * where the first one ends.
+ *
+ * @returns: the start of the first mapping, NULL on failure (errno is set)
+ */
+static void* map_mirrored(const size_t size) {
+	const int fd = memfd_create("witui-ring", MFD_CLOEXEC);
+	if (fd < 0) {
+		return NULL;
+	}
+	if (ftruncate(fd, size) != 0) {
+		close(fd);
+		return NULL;
+	}
+
+	/* Reserve room for both first, so nothing else ends up in between */
+	char* area = mmap(
+		NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+	);
+	if (area == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+
+	for (int i = 0; i < 2; i++) {
+		void* half = mmap(
+			area + i * size, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_FIXED, fd, 0
+		);
+		if (half == MAP_FAILED) {
+			const int error = errno;
+			munmap(area, 2 * size);
+			close(fd);
+			errno = error;
+			return NULL;
+		}
+	}
+	close(fd);
+
+	return area;
+}
+
+static size_t round_to_pages(const size_t size) {
+	const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+	return (size + page_size - 1) / page_size * page_size;
+}
+
+wi_ring* make_ring(const int max_lines, const int max_bytes) {
+	if (max_lines < 0 || max_bytes <= 0 || max_bytes >= INT_MAX / 2) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	wi_ring* ring = (wi_ring*) malloc(sizeof(wi_ring));
+	if (ring == NULL) {
+		return NULL;
+	}
+
+	/* Every line that's done ends with a newline, so there can't be more
+	 * lines than bytes */
+	ring->max_bytes = max_bytes;
+	ring->max_lines =
+		max_lines == 0 || max_lines > max_bytes ? max_bytes : max_lines;
+
+	/* One more byte for the nullbyte after the text */
+	ring->text_size = round_to_pages((size_t) max_bytes + 1);
+	const size_t lines_size = round_to_pages(
+		((size_t) ring->max_lines + WI_RING_LINE_SLACK) * sizeof(wi_string_view)
+	);
+	ring->line_capacity = (int) (lines_size / sizeof(wi_string_view));
+
+	ring->text = map_mirrored(ring->text_size);
+	if (ring->text == NULL) {
+		free(ring);
+		return NULL;
+	}
+	ring->lines = map_mirrored(lines_size);
+	if (ring->lines == NULL) {
+		munmap(ring->text, 2 * ring->text_size);
+		free(ring);
+		return NULL;
+	}
+
+	return ring;
+}
+
+void free_ring(wi_ring* ring) {
+	if (ring == NULL) {
+		return;
+	}
+	munmap(ring->text, 2 * ring->text_size);
+	munmap(ring->lines, 2 * (size_t) ring->line_capacity * sizeof(wi_string_view));
+	free(ring);
+}
@@ -0,0 +1,132 @@
+#include <stdbool.h>	/* bool, true, false */
+#include <stdlib.h>		/* malloc(), free() */
+#include <threads.h>	/* thrd_t, mtx_t, cnd_t */
+
+#include "wiAssert.h"	/* wiAssert() */
+
+#include "wi_internals.h"
+#include "wi_data.h"
+
+/*
+ * Run the items of the current batch that no thread took yet.
+ * Called with the lock of the pool held, which is released while running.
+ */
+static void run_items(wi_thread_pool* pool) {
+	while (pool->next_item < pool->amount_items) {
+		void* item = pool->items[pool->next_item];
+		pool->next_item++;
+
+		mtx_unlock(&(pool->lock));
+		pool->function(item);
+		mtx_lock(&(pool->lock));
+
+		pool->unfinished_items--;
+		if (pool->unfinished_items == 0) {
+			cnd_broadcast(&(pool->work_finished));
+		}
+	}
+}
+
+static int pool_worker(void* args) {
+	wi_thread_pool* pool = (wi_thread_pool*) args;
+
+	mtx_lock(&(pool->lock));
+	while (true) {
+		while (!pool->stopping && pool->next_item >= pool->amount_items) {
+			cnd_wait(&(pool->work_available), &(pool->lock));
+		}
+		if (pool->stopping) {
+			break;
+		}
+		run_items(pool);
+	}
+	mtx_unlock(&(pool->lock));
+
+	return 0;
+}
+
+wi_thread_pool* make_thread_pool(const int amount_threads) {
+	if (amount_threads <= 0) {
+		return NULL;
+	}
+
+	wi_thread_pool* pool = (wi_thread_pool*) malloc(sizeof(wi_thread_pool));
+	wiAssert(pool != NULL, "Failed to allocate thread-pool.");
+	pool->threads = (thrd_t*) malloc(amount_threads * sizeof(thrd_t));
+	wiAssert(pool->threads != NULL, "Failed to allocate thread-pool.");
+
+	wiAssert(
+		mtx_init(&(pool->lock), mtx_plain) == thrd_success
+		&& cnd_init(&(pool->work_available)) == thrd_success
+		&& cnd_init(&(pool->work_finished)) == thrd_success,
+		"Failed to initialise thread-pool."
+	);
+	pool->stopping = false;
+	pool->function = NULL;
+	pool->items = NULL;
+	pool->amount_items = 0;
+	pool->next_item = 0;
+	pool->unfinished_items = 0;
+
+	pool->amount_threads = 0;
+	for (int i = 0; i < amount_threads; i++) {
+		if (thrd_create(&(pool->threads[i]), pool_worker, pool) != thrd_success) {
+			/* Fewer threads still work */
+			break;
+		}
+		pool->amount_threads++;
+	}
+
+	return pool;
+}
+
+void free_thread_pool(wi_thread_pool* pool) {
+	if (pool == NULL) {
+		return;
+	}
+
+	mtx_lock(&(pool->lock));
+	pool->stopping = true;
+	cnd_broadcast(&(pool->work_available));
+	mtx_unlock(&(pool->lock));
+
+	for (int i = 0; i < pool->amount_threads; i++) {
+		thrd_join(pool->threads[i], NULL);
+	}
+
+	cnd_destroy(&(pool->work_finished));
+	cnd_destroy(&(pool->work_available));
+	mtx_destroy(&(pool->lock));
+	free(pool->threads);
+	free(pool);
+}
+
+void run_in_thread_pool(
+	wi_thread_pool* pool, void (*function)(void*),
+	void** items, const int amount_items
+) {
+	if (pool == NULL || pool->amount_threads == 0 || amount_items <= 1) {
+		for (int i = 0; i < amount_items; i++) {
+			function(items[i]);
+		}
+		return;
+	}
+
+	mtx_lock(&(pool->lock));
+	pool->function = function;
+	pool->items = items;
+	pool->amount_items = amount_items;
+	pool->next_item = 0;
+	pool->unfinished_items = amount_items;
+	cnd_broadcast(&(pool->work_available));
+
+	/* Help out instead of only waiting */
+	run_items(pool);
+	while (pool->unfinished_items > 0) {
+		cnd_wait(&(pool->work_finished), &(pool->lock));
+	}
+
+	pool->amount_items = 0;
+	pool->next_item = 0;
+	mtx_unlock(&(pool->lock));
+}
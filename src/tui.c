@@ -3,11 +3,18 @@
 #include "wi_internals.h"
 #include "wi_functions.h"
 
+#include <errno.h>		/* errno, EFBIG, EINVAL */
+#include <fcntl.h>		/* open(), O_RDONLY, O_CLOEXEC */
+#include <limits.h>		/* INT_MAX */
+#include <stdatomic.h>	/* atomic_init(), atomic_store() */
 #include <stdbool.h>	/* true, false */
 #include <stddef.h>		/* size_t */
 #include <stdlib.h>		/* malloc(), realloc(), free() */
 #include <string.h>		/* strdup(), strchr(), strlen() */
+#include <sys/mman.h>	/* mmap(), munmap(), madvise() */
+#include <sys/stat.h>	/* fstat(), struct stat */
 #include <threads.h>	/* thrd_sleep() */
+#include <unistd.h>		/* close(), sysconf() */
 
 /* Fore safety this is undeffed at the end of the file */
 #define MALLOC_ARRAY(ARRAY, SIZE, TYPE) \
@@ -61,6 +68,8 @@ wi_window* wi_make_window(void) {
 	};
 
 	window->wrap_text = false;
+	window->lazy_content = false;
+	window->follow_tail = false;
 	window->cursor_rendering = POINTBASED;
 
 	window->depends_on = NULL;
@@ -72,6 +81,13 @@ wi_window* wi_make_window(void) {
 	window->internal.visual_cursor = (wi_position) { 0, 0 };
 	window->internal.currently_focussed = false;
 
+	window->internal.session = NULL;
+
+	/* Nothing has been rendered yet */
+	atomic_init(&(window->internal.dirty), true);
+	window->internal.rendered_content = NULL;
+	window->internal.follow_pending = false;
+
 	return window;
 }
 
@@ -88,7 +104,38 @@ wi_session* wi_make_session(bool add_vim_keybindings) {
 	CALLOC_ARRAY(session->internal.amount_cols, 2, int, 0);
 	CALLOC_ARRAY(session->internal.capacity_cols, 2, int, 2);
 
+	atomic_init(&(session->internal.resize_pending), true);
+	session->internal.terminal_rows = 0;
+	session->internal.terminal_cols = 0;
+
+	session->internal.frame_windows_redrawn = 0;
+	session->internal.wrap_pool = NULL;
+	session->internal.stats = (wi_stats) { 0 };
+	wiAssert(
+		mtx_init(&(session->internal.stats_lock), mtx_plain) == thrd_success,
+		"Failed to create the lock for the session-statistics"
+	);
+	wiAssert(
+		mtx_init(
+			&(session->internal.content_lock), mtx_plain | mtx_recursive
+		) == thrd_success,
+		"Failed to create the lock for the session-content"
+	);
+	atomic_init(&(session->internal.pending_keypress_ns), 0);
+
+	/* Only open while the session is shown */
+	session->internal.render_wake_pipe[0] = -1;
+	session->internal.render_wake_pipe[1] = -1;
+	session->internal.input_wake_pipe[0] = -1;
+	session->internal.input_wake_pipe[1] = -1;
+
 	session->start_clear_screen = false;
+	session->diff_rendering = false;
+	session->scroll_margins = false;
+	session->max_frame_rate = 0;
+	session->collect_stats = false;
+	session->wrap_cache_size = 1024 * 1024;
+	session->wrap_threads = 1;
 	session->focus_pos = (wi_position) { 0, 0 };
 
 	/* Start with room for 15, so that when used with the standard vim keybinds,
@@ -98,6 +145,9 @@ wi_session* wi_make_session(bool add_vim_keybindings) {
 		session->keymaps, keymap_array_size, wi_keymap, { .callback = NULL }
 	);
 	session->internal.keymap_array_size = keymap_array_size;
+	atomic_init(&(session->internal.keymap_table), NULL);
+	session->internal.retired_keymap_tables = NULL;
+	compile_keymaps(session);
 
 	if (add_vim_keybindings) {
 		wi_add_keymap_to_session(session, 'h', NONE, wi_scroll_left);
@@ -114,6 +164,20 @@ wi_session* wi_make_session(bool add_vim_keybindings) {
 	session->keep_running = true;
 	session->running_render_thread = false;
 
+	/* Grows on the first frame */
+	session->internal.frame = (wi_frame_buffer) {
+		.data = NULL, .length = 0, .capacity = 0
+	};
+	session->internal.compacted_frame = (wi_frame_buffer) {
+		.data = NULL, .length = 0, .capacity = 0
+	};
+	/* Only allocated when the first diffed frame is rendered */
+	session->internal.screen = (wi_screen) {
+		.front = NULL, .back = NULL, .rows = 0, .cols = 0, .valid = false,
+		.styles = NULL, .amount_styles = 0, .styles_capacity = 0,
+		.extras = NULL, .amount_extras = 0, .extras_capacity = 0
+	};
+
 	return session;
 }
 
@@ -129,6 +193,7 @@ wi_session* wi_add_keymap_to_session(
 				.key = key,
 				.callback = callback
 			};
+			compile_keymaps(session);
 			return session;
 		}
 	}
@@ -147,6 +212,7 @@ wi_session* wi_add_keymap_to_session(
 		.callback = callback
 	};
 	session->internal.keymap_array_size += 15;
+	compile_keymaps(session);
 
 	return session;
 }
@@ -159,6 +225,7 @@ wi_session* wi_pop_keymap_from_session(
 		map = session->keymaps[i];
 		if (map.callback != NULL && map.key == key && map.modifier == modifier){
 			session->keymaps[i].callback = NULL;
+			compile_keymaps(session);
 			return session;
 		}
 	}
@@ -174,6 +241,7 @@ wi_session* wi_update_keymap_from_session(
 		map = session->keymaps[i];
 		if (map.callback != NULL && map.key == key && map.modifier == modifier){
 			session->keymaps[i].callback = new_callback;
+			compile_keymaps(session);
 			return session;
 		}
 	}
@@ -217,6 +285,7 @@ wi_session* wi_add_window_to_session(wi_session* session, wi_window* window, int
 
 	session->windows[row][amount_on_row] = window;
 	session->internal.amount_cols[row] += 1;
+	window->internal.session = session;
 
 	return session;
 }
@@ -228,10 +297,14 @@ wi_window* wi_add_content_to_window(wi_window* window, char* content, const wi_p
 			.original.string = content,
 			.line_list = NULL
 		};
+	} else if (window->lazy_content) {
+		processed_content = lazy_split_lines(content);
 	} else {
 		processed_content = split_lines(content);
 	}
 
+	lock_content(window->internal.session);
+
 	/* Make new rows if needed */
 	int old_row_capacity = window->internal.content_grid_row_capacity;
 	if (position.row >= old_row_capacity) {
@@ -269,6 +342,197 @@ wi_window* wi_add_content_to_window(wi_window* window, char* content, const wi_p
 	}
 
 	window->content_grid[position.row][position.col] = processed_content;
+	if (
+		window->follow_tail
+		&& &(window->content_grid[position.row][position.col])
+			== current_window_content(window)
+	) {
+		window->internal.follow_pending = true;
+	}
+	atomic_store(&(window->internal.dirty), true);
+	unlock_content(window->internal.session);
+	if (window->internal.session != NULL) {
+		request_rerender(window->internal.session);
+	}
+
+	return window;
+}
+
+/*
+ * Map a file read-only, followed by at least one page of zeroes. That ends
+ * the string with a nullbyte, and characters cut off by the end of the file
+ * can't make the library read past the mapping.
+ *
+ * @returns: the mapping, NULL on failure (with errno set)
+ */
+static char* map_file(const char* path, size_t* mapped_size) {
+	const int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) < 0) {
+		const int error = errno;
+		close(fd);
+		errno = error;
+		return NULL;
+	}
+	if (!S_ISREG(file_stat.st_mode) || file_stat.st_size >= INT_MAX) {
+		close(fd);
+		/* Content is indexed with ints */
+		errno = S_ISREG(file_stat.st_mode) ? EFBIG : EINVAL;
+		return NULL;
+	}
+
+	const size_t file_size = (size_t) file_stat.st_size;
+	const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+	*mapped_size = ((file_size + page_size - 1) / page_size + 1) * page_size;
+
+	char* mapping = (char*) mmap(
+		NULL, *mapped_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0
+	);
+	if (mapping == MAP_FAILED) {
+		const int error = errno;
+		close(fd);
+		errno = error;
+		return NULL;
+	}
+	if (
+		file_size > 0
+		&& mmap(
+			mapping, file_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0
+		) == MAP_FAILED
+	) {
+		const int error = errno;
+		munmap(mapping, *mapped_size);
+		close(fd);
+		errno = error;
+		return NULL;
+	}
+	close(fd);
+
+	/* Splitting goes through it front to back, so read ahead and don't keep
+	 * what was already split around */
+	if (file_size > 0) {
+		madvise(mapping, file_size, MADV_SEQUENTIAL);
+	}
+
+	return mapping;
+}
+
+wi_window* wi_add_file_content_to_window(
+	wi_window* window, const char* path, const wi_position position
+) {
+	size_t mapped_size = 0;
+	char* mapping = map_file(path, &mapped_size);
+	if (mapping == NULL) {
+		return NULL;
+	}
+
+	lock_content(window->internal.session);
+	wi_add_content_to_window(window, mapping, position);
+	window->content_grid[position.row][position.col].mapped_size = mapped_size;
+	unlock_content(window->internal.session);
+
+	return window;
+}
+
+wi_window* wi_add_bounded_content_to_window(
+	wi_window* window, const int max_lines, const size_t max_bytes,
+	const wi_position position
+) {
+	/* The ring only holds whole lines, which can't be wrapped in it */
+	if (max_bytes >= INT_MAX / 2 || window->wrap_text) {
+		errno = EINVAL;
+		return NULL;
+	}
+	wi_ring* ring = make_ring(max_lines, (int) max_bytes);
+	if (ring == NULL) {
+		return NULL;
+	}
+
+	lock_content(window->internal.session);
+	wi_add_content_to_window(window, ring->text, position);
+
+	/* Replace what got split above by the lines in the ring */
+	wi_content* content = &(window->content_grid[position.row][position.col]);
+	wi_free_content(*content);
+	*content = bounded_content(ring);
+	unlock_content(window->internal.session);
+
+	return window;
+}
+
+/*
+ * Move the cursor up along with the lines it is on, after `amount` lines got
+ * evicted from before it.
+ */
+static void follow_evicted_lines(wi_window* window, const int amount) {
+	wi_position* visual = &(window->internal.visual_cursor);
+	wi_position* offset = &(window->internal.offset_cursor);
+
+	offset->row -= amount;
+	if (offset->row < 0) {
+		visual->row += offset->row;
+		offset->row = 0;
+	}
+	if (visual->row < 0) {
+		visual->row = 0;
+	}
+}
+
+wi_window* wi_append_content(
+	wi_window* window, const char* text, const wi_position position
+) {
+	const size_t length = strlen(text);
+	wi_session* session = window->internal.session;
+
+	lock_content(session);
+	const bool exists =
+		position.row < window->internal.content_grid_row_capacity
+		&& position.col < window->internal.content_grid_col_capacity[position.row]
+		&& window->content_grid[position.row][position.col].original.string != NULL;
+
+	if (!exists) {
+		char* copy = (char*) malloc(length + 1);
+		wiAssert(copy != NULL, "Failed to allocate appendable content.");
+		memcpy(copy, text, length + 1);
+
+		wi_add_content_to_window(window, copy, position);
+		wi_content* content = &(window->content_grid[position.row][position.col]);
+		content->appendable_capacity = length + 1;
+		content->appendable_length = length;
+		unlock_content(session);
+
+		return window;
+	}
+
+	wi_content* content = &(window->content_grid[position.row][position.col]);
+	if (window->follow_tail && content == current_window_content(window)) {
+		/* Only follow when the cursor is at the end, so scrolling up to read
+		 * something isn't undone by the next append */
+		const int cursor_row = window->internal.visual_cursor.row
+			+ window->internal.offset_cursor.row;
+		if (
+			content->line_list == NULL
+			|| (content->fully_split && cursor_row + 1 >= content->amount_lines)
+		) {
+			window->internal.follow_pending = true;
+		}
+	}
+
+	const int evicted = append_to_content(content, text, length);
+	if (evicted > 0 && content == current_window_content(window)) {
+		follow_evicted_lines(window, evicted);
+	}
+	atomic_store(&(window->internal.dirty), true);
+	unlock_content(session);
+
+	/* Only asks for a frame, so quick appends end up in the same one */
+	if (session != NULL) {
+		request_rerender(session);
+	}
 
 	return window;
 }
@@ -301,12 +565,16 @@ wi_window* wi_get_focussed_window(wi_session* session) {
 }
 
 wi_content wi_get_current_window_content(const wi_window* window) {
+	return *current_window_content(window);
+}
+
+wi_content* current_window_content(const wi_window* window) {
 	wiAssert(
 		window->content_grid != NULL,
 		"Window does not containt any contents!"
 	);
 	if (window->depends_on == NULL) {
-		return window->content_grid[0][0];
+		return &(window->content_grid[0][0]);
 	}
 
 	wi_window* dep = window->depends_on;
@@ -335,14 +603,61 @@ wi_content wi_get_current_window_content(const wi_window* window) {
 		"Could not find non-NULL content for a depending window"
 	);
 
-	return window->content_grid[row][col];
+	return &(window->content_grid[row][col]);
+}
+
+void wrap_window_prefix(
+	wi_window* window, wi_content* content, const int max_bytes
+) {
+	if (content->prefix == NULL || !continue_wrap_prefix(content, max_bytes)) {
+		return;
+	}
+
+	const int amount = merge_wrap_prefix(content);
+	if (content == current_window_content(window)) {
+		window->internal.offset_cursor.row += amount;
+	}
+}
+
+void split_window_lines(const wi_window* window, const int amount_lines) {
+	wi_content* content = current_window_content(window);
+	if (
+		!content->fully_split && content->line_list != NULL
+		&& content->amount_lines < amount_lines
+	) {
+		continue_split_lines(content, amount_lines, INT_MAX);
+	}
+}
+
+void lock_content(wi_session* session) {
+	if (session != NULL) {
+		mtx_lock(&(session->internal.content_lock));
+	}
+}
+
+void unlock_content(wi_session* session) {
+	if (session != NULL) {
+		mtx_unlock(&(session->internal.content_lock));
+	}
 }
 
 wi_position wi_get_window_cursor_pos(const wi_window *window) {
-	const wi_content window_content = wi_get_current_window_content(window);
 	const wi_position visual = window->internal.visual_cursor;
 	const wi_position offset = window->internal.offset_cursor;
 
+	lock_content(window->internal.session);
+	split_window_lines(window, visual.row + offset.row + 1);
+	wi_content* content = current_window_content(window);
+
+	/* After a resize, the lines before the ones that got rewrapped first
+	 * are still missing from the row. Only counted, the render-thread wraps
+	 * them when it has the time */
+	int missing_rows = 0;
+	if (content->prefix != NULL) {
+		missing_rows = count_wrap_prefix_lines(content);
+	}
+	const wi_content window_content = *content;
+
 	wi_position actual = (wi_position) {
 		.row = visual.row + offset.row,
 		.col = visual.col + offset.col
@@ -354,6 +669,9 @@ wi_position wi_get_window_cursor_pos(const wi_window *window) {
 	if (actual.col >= (int) window_content.line_list[actual.row].length.width) {
 		actual.col = window_content.line_list[actual.row].length.width - 1;
 	}
+	actual.row += missing_rows;
+
+	unlock_content(window->internal.session);
 
 	return actual;
 }
@@ -361,6 +679,8 @@ wi_position wi_get_window_cursor_pos(const wi_window *window) {
 void wi_quit_rendering(const char _, wi_session* session) {
 	(void)(_);
 	session->keep_running = false;
+	wake_render_thread(session);
+	wake_input_thread(session);
 }
 
 void wi_quit_rendering_and_wait(const char _, wi_session* session) {
@@ -388,6 +708,24 @@ void wi_free_session(wi_session* session) {
 	free(session->internal.amount_cols);
 	free(session->internal.capacity_cols);
 	free(session->keymaps);
+	free(atomic_load(&(session->internal.keymap_table)));
+	wi_keymap_table* table = session->internal.retired_keymap_tables;
+	while (table != NULL) {
+		wi_keymap_table* next = table->retired_next;
+		free(table);
+		table = next;
+	}
+	free(session->internal.frame.data);
+	free(session->internal.compacted_frame.data);
+	free(session->internal.screen.front);
+	free(session->internal.screen.back);
+	free(session->internal.screen.styles);
+	for (int i = 0; i < session->internal.screen.amount_extras; i++) {
+		free(session->internal.screen.extras[i]);
+	}
+	free(session->internal.screen.extras);
+	mtx_destroy(&(session->internal.stats_lock));
+	mtx_destroy(&(session->internal.content_lock));
 	free(session);
 }
 
@@ -396,7 +734,14 @@ void wi_free_window(wi_window* window) {
 
 	for (int i = 0; i < window->internal.content_grid_row_capacity; i++) {
 		for (int j = 0; j < window->internal.content_grid_col_capacity[i]; j++) {
-			wi_free_content(window->content_grid[i][j]);
+			const wi_content content = window->content_grid[i][j];
+			wi_free_content(content);
+			if (content.mapped_size > 0) {
+				munmap(content.original.string, content.mapped_size);
+			}
+			if (content.appendable_capacity > 0) {
+				free(content.original.string);
+			}
 		}
 		free(window->content_grid[i]);
 	}
@@ -407,7 +752,23 @@ void wi_free_window(wi_window* window) {
 
 void wi_free_content(wi_content content) {
 	if (content.original.string != NULL) {
-		free(content.line_list);
+		free_column_index(content.column_index);
+		if (content.ring != NULL) {
+			/* The lines live in the ring as well */
+			free_ring(content.ring);
+		} else {
+			free(content.line_list);
+		}
+		if (content.prefix != NULL) {
+			free(content.prefix->lines);
+			free(content.prefix);
+		}
+		if (content.wrap_cache != NULL) {
+			for (int i = 0; i < content.wrap_cache->amount_entries; i++) {
+				wi_free_content(content.wrap_cache->entries[i]);
+			}
+			free(content.wrap_cache);
+		}
 	}
 }
 
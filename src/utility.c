@@ -3,8 +3,105 @@
 #include "wi_internals.h"
 #include "wi_functions.h"
 
+#include <limits.h>		/* INT_MAX */
+#include <stdatomic.h>	/* atomic_store() */
 #include <stdio.h>
 #include <stdlib.h> 	/* malloc(), realloc() */
+#include <string.h>		/* strlen(), strnlen(), memchr(), memcpy() */
+#include <sys/mman.h>	/* munmap() */
+
+/*
+ * Text is scanned WI_SIMD_WIDTH bytes at a time for newlines and for bytes
+ * that are not plain ASCII (UTF-8 and escape-sequences), which need the
+ * slower character-by-character path.
+ * Without SSE2 or AVX2 only that character-by-character path is used.
+ *
+ * WI_SIMD_MATCH() gives a bitmask of the bytes equal to a character,
+ * WI_SIMD_BIT() one of the bytes that have bit `n` set (7 being the highest).
+ */
+#if defined(__AVX2__)
+#include <immintrin.h>	/* _mm256_*() */
+#define WI_SIMD_WIDTH 32
+typedef __m256i wi_simd_vector;
+#define WI_SIMD_LOAD(p) _mm256_loadu_si256((const __m256i*) (p))
+#define WI_SIMD_MATCH(v, c) \
+	(wi_simd_mask) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)))
+#define WI_SIMD_BIT(v, n) \
+	(wi_simd_mask) _mm256_movemask_epi8(_mm256_slli_epi16(v, 7 - (n)))
+#elif defined(__SSE2__)
+#include <emmintrin.h>	/* _mm_*() */
+#define WI_SIMD_WIDTH 16
+typedef __m128i wi_simd_vector;
+#define WI_SIMD_LOAD(p) _mm_loadu_si128((const __m128i*) (p))
+#define WI_SIMD_MATCH(v, c) \
+	(wi_simd_mask) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)))
+#define WI_SIMD_BIT(v, n) \
+	(wi_simd_mask) _mm_movemask_epi8(_mm_slli_epi16(v, 7 - (n)))
+#endif
+
+#ifdef WI_SIMD_WIDTH
+typedef unsigned int wi_simd_mask;
+
+/* Bitmask of the bytes from position `n` in the chunk on */
+#define WI_SIMD_FROM(n) (~(wi_simd_mask) 0 << (n))
+
+static inline void scan_chunk(
+	const char* chunk, wi_simd_mask* newlines, wi_simd_mask* special
+) {
+	const wi_simd_vector bytes = WI_SIMD_LOAD(chunk);
+	*newlines = WI_SIMD_MATCH(bytes, '\n');
+	*special = WI_SIMD_BIT(bytes, 7) | WI_SIMD_MATCH(bytes, '\033');
+}
+
+/* Whether the chunk has nothing but ASCII and no escapes */
+static inline bool plain_chunk(const char* chunk) {
+	const wi_simd_vector bytes = WI_SIMD_LOAD(chunk);
+	return (WI_SIMD_BIT(bytes, 7) | WI_SIMD_MATCH(bytes, '\033')) == 0;
+}
+
+/*
+ * Which bytes in the chunk are UTF-8 lead-bytes (of any length, of 3 or more
+ * and of 4 bytes), continuation-bytes, escapes and the 'm's ending them.
+ * Uses the same classification as `wi_char_byte_size()`.
+ */
+typedef struct {
+	wi_simd_mask lead;
+	wi_simd_mask lead_3;
+	wi_simd_mask lead_4;
+	wi_simd_mask continuation;
+	wi_simd_mask escapes;
+	wi_simd_mask escape_ends;
+} utf8_chunk;
+
+static inline utf8_chunk scan_utf8_chunk(const char* chunk) {
+	const wi_simd_vector bytes = WI_SIMD_LOAD(chunk);
+	const wi_simd_mask bit7 = WI_SIMD_BIT(bytes, 7);
+	const wi_simd_mask bit6 = WI_SIMD_BIT(bytes, 6);
+	const wi_simd_mask lead = bit7 & bit6;
+	const wi_simd_mask lead_3 = lead & WI_SIMD_BIT(bytes, 5);
+
+	return (utf8_chunk) {
+		.lead = lead,
+		.lead_3 = lead_3,
+		.lead_4 = lead_3 & WI_SIMD_BIT(bytes, 4),
+		.continuation = bit7 & ~bit6,
+		.escapes = WI_SIMD_MATCH(bytes, '\033'),
+		.escape_ends = WI_SIMD_MATCH(bytes, 'm')
+	};
+}
+
+/*
+ * Where continuation-bytes should be according to the lead-bytes selected by
+ * `leads`. The last character can continue past the chunk, so this is wider.
+ */
+static inline unsigned long long expected_continuation(
+	const utf8_chunk chunk, const unsigned long long leads
+) {
+	return ((chunk.lead & leads) << 1)
+		| ((chunk.lead_3 & leads) << 2)
+		| ((chunk.lead_4 & leads) << 3);
+}
+#endif
 
 #define ADD_STR_LEN(X, Y) \
 	X.width += (Y).width; \
@@ -14,16 +111,62 @@
 	(x).width += a; \
 	(x).bytes += a;
 
+/* Width of a character, in 2 loads from the width-table */
+static inline unsigned int codepoint_width(const unsigned int codepoint) {
+	const unsigned char block = width_table_blocks[codepoint >> 8];
+	const unsigned char widths =
+		width_table_widths[block][(codepoint & 0xFF) >> 2];
+	return (widths >> ((codepoint & 3) * 2)) & 3;
+}
+
+/*
+ * Width of the UTF-8 character of `bytes` bytes at `c`. Malformed characters
+ * are 1 wide, and it stops at the first byte that's not a continuation-byte,
+ * so it doesn't read past a nullbyte.
+ */
+static inline unsigned int utf8_width(const char* c, const int bytes) {
+	const unsigned char* u = (const unsigned char*) c;
+	unsigned int codepoint = u[0] & (0x7F >> bytes);
+
+	for (int i = 1; i < bytes; i++) {
+		if ((u[i] & 0xC0) != 0x80) {
+			return 1;
+		}
+		codepoint = (codepoint << 6) | (u[i] & 0x3F);
+	}
+
+	return codepoint > 0x10FFFF ? 1 : codepoint_width(codepoint);
+}
+
+#ifdef WI_SIMD_WIDTH
+/*
+ * Same as `utf8_width()`, for a character that is known to have all of its
+ * continuation-bytes, so they don't have to be checked one by one.
+ */
+static inline unsigned int whole_utf8_width(const char* c, const int bytes) {
+	const unsigned char* u = (const unsigned char*) c;
+	if (bytes == 2) {
+		return codepoint_width((u[0] & 0x1F) << 6 | (u[1] & 0x3F));
+	} else if (bytes == 3) {
+		return codepoint_width(
+			(u[0] & 0x0F) << 12 | (u[1] & 0x3F) << 6 | (u[2] & 0x3F)
+		);
+	}
+	const unsigned int codepoint = (u[0] & 0x07) << 18 | (u[1] & 0x3F) << 12
+		| (u[2] & 0x3F) << 6 | (u[3] & 0x3F);
+	return codepoint > 0x10FFFF ? 1 : codepoint_width(codepoint);
+}
+#endif
+
 wi_string_length wi_char_byte_size(const char* c) {
-	if (*c == '\0') {
+	const unsigned char byte = *c;
+	if (byte >= 0xC0) {
+		/* Lead-byte of 11110000, 11100000 or 11000000 */
+		const int bytes = byte >= 0xF0 ? 4 : byte >= 0xE0 ? 3 : 2;
+		return (wi_string_length) { .width = utf8_width(c, bytes), .bytes = bytes };
+	} else if (byte == '\0') {
 		return (wi_string_length) { .width = 0, .bytes = 1 };
-	} else if ((*c & 0xF0) == 0xF0) { 	/* 11110000 */
-		return (wi_string_length) { .width = 1, .bytes = 4 };
-	} else if ((*c & 0xE0) == 0xE0) { 	/* 11100000 */
-		return (wi_string_length) { .width = 1, .bytes = 3 };
-	} else if ((*c & 0xC0) == 0xC0) { 	/* 11000000 */
-		return (wi_string_length) { .width = 1, .bytes = 2 };
-	} else if (*c == '\033') {
+	} else if (byte == '\033') {
 		unsigned short bytes = 1;
 		do {
 			bytes++;
@@ -39,11 +182,102 @@ wi_string_length wi_strlen(const char* c) {
 	wi_string_length result = { 0, 0 };
 	wi_string_length charlen;
 
+#ifdef WI_SIMD_WIDTH
+	/* Knowing where the string ends lets the chunks be read without
+	 * looking past the nullbyte */
+	const unsigned int length = strlen(c);
+	unsigned int bytes = 0;
+
+	while (bytes + WI_SIMD_WIDTH <= length) {
+		if (plain_chunk(c + bytes)) {
+			INCREMENT_STR_LEN(result, WI_SIMD_WIDTH)
+			bytes += WI_SIMD_WIDTH;
+			continue;
+		}
+
+		const unsigned int chunk_start = bytes;
+		const unsigned int chunk_end = bytes + WI_SIMD_WIDTH;
+		const utf8_chunk chunk = scan_utf8_chunk(c + bytes);
+
+		/* Between the escapes, every ASCII byte is a character of width 1
+		 * and every lead-byte starts one whose width is looked up, as long as
+		 * every lead-byte is followed by the right amount of
+		 * continuation-bytes. All runs of the chunk use the one scan */
+		bool well_formed = true;
+		while (bytes < chunk_end) {
+			const unsigned int from = bytes - chunk_start;
+			const wi_simd_mask escapes = chunk.escapes & WI_SIMD_FROM(from);
+			const unsigned int to = escapes == 0
+				? WI_SIMD_WIDTH : (unsigned) __builtin_ctz(escapes);
+			const unsigned long long in_run =
+				((1ULL << to) - 1) & ~((1ULL << from) - 1);
+			const unsigned long long expected = expected_continuation(chunk, in_run);
+			const unsigned int spill = __builtin_popcountll(expected >> to);
+
+			if (
+				(expected & in_run) != (chunk.continuation & in_run)
+				|| (to == WI_SIMD_WIDTH ? bytes + to - from + spill > length : spill != 0)
+			) {
+				well_formed = false;
+				break;
+			}
+
+			result.width += __builtin_popcountll(
+				~(chunk.lead | chunk.continuation) & in_run
+			);
+			wi_simd_mask leads = chunk.lead & in_run;
+			while (leads != 0) {
+				const int lead = __builtin_ctz(leads);
+				const int lead_bytes = (chunk.lead_4 >> lead) & 1 ? 4
+					: (chunk.lead_3 >> lead) & 1 ? 3 : 2;
+				result.width += whole_utf8_width(c + chunk_start + lead, lead_bytes);
+				leads &= leads - 1;
+			}
+			result.bytes += to - from + spill;
+			bytes += to - from + spill;
+
+			if (to < WI_SIMD_WIDTH) {
+				/* Skip the whole escape-sequence up to its 'm', mostly found
+				 * in the same chunk */
+				const wi_simd_mask ends = to + 1 < WI_SIMD_WIDTH
+					? chunk.escape_ends & WI_SIMD_FROM(to + 1) : 0;
+				if (ends != 0) {
+					const unsigned int escape_bytes = __builtin_ctz(ends) - to + 1;
+					result.bytes += escape_bytes;
+					bytes += escape_bytes;
+					continue;
+				}
+				const char* end = memchr(c + bytes + 1, 'm', length - bytes - 1);
+				const unsigned int escape_bytes = end != NULL
+					? (unsigned) (end - (c + bytes)) + 1 : length - bytes + 1;
+				result.bytes += escape_bytes;
+				bytes += escape_bytes;
+			}
+		}
+		if (well_formed) {
+			continue;
+		}
+
+		/* Malformed UTF-8, do this chunk one character at a time */
+		while (bytes < chunk_end) {
+			charlen = wi_char_byte_size(c + bytes);
+			ADD_STR_LEN(result, charlen);
+			bytes += charlen.bytes;
+		}
+	}
+
+	while (bytes < length) {
+		charlen = wi_char_byte_size(c + bytes);
+		ADD_STR_LEN(result, charlen);
+		bytes += charlen.bytes;
+	}
+#else
 	while (*c != '\0') {
 		charlen = wi_char_byte_size(c);
 		ADD_STR_LEN(result, charlen);
 		c += charlen.bytes;
 	}
+#endif
 
 	return result;
 }
@@ -53,63 +287,398 @@ wi_string_length wi_strlen(const char* c) {
 	line_list[i].length.bytes = 0; \
 	line_list[i].string = char_p;
 
-wi_content split_lines(char* content) {
-	wi_string_view original;
-	original.string = content;
-	original.length = (wi_string_length) { 0, 0 };
+/*
+ * An empty column-index, the array is only allocated once a line needs
+ * checkpoints or spans.
+ */
+static wi_column_index* make_column_index(void) {
+	wi_column_index* index = (wi_column_index*) malloc(sizeof(wi_column_index));
+	wiAssert(index != NULL, "Failed to allocate a column-index");
+	index->lines = NULL;
+	index->amount_lines = 0;
+	index->first_line = 0;
+	return index;
+}
+
+/* Free what is known about a line, it has to be found out again */
+static void forget_line_index(wi_line_index* line) {
+	free(line->checkpoints);
+	free(line->spans);
+	line->checkpoints = NULL;
+	line->amount_checkpoints = 0;
+	line->spans = NULL;
+	line->amount_spans = -1;
+	line->carried.known = false;
+}
+
+void free_column_index(wi_column_index* index) {
+	if (index == NULL) {
+		return;
+	}
+	for (int i = 0; i < index->first_line + index->amount_lines; i++) {
+		forget_line_index(&(index->lines[i]));
+	}
+	free(index->lines);
+	free(index);
+}
+
+/*
+ * The entry of a line in the column-index, growing the index when the
+ * content got more lines.
+ */
+static wi_line_index* line_index(const wi_content* content, const int line) {
+	wi_column_index* index = content->column_index;
+
+	/* Lazily split content can have gotten more lines */
+	if (line >= index->amount_lines) {
+		const int first = index->first_line;
+		const int amount_lines = content->amount_lines;
+		index->lines = (wi_line_index*) realloc(
+			index->lines, (first + amount_lines) * sizeof(wi_line_index)
+		);
+		wiAssert(index->lines != NULL, "Failed to allocate a column-index");
+		for (int i = first + index->amount_lines; i < first + amount_lines; i++) {
+			index->lines[i] = (wi_line_index) {
+				.checkpoints = NULL, .amount_checkpoints = 0,
+				.spans = NULL, .amount_spans = -1, .carried.known = false
+			};
+		}
+		index->amount_lines = amount_lines;
+	}
+	return &(index->lines[index->first_line + line]);
+}
+
+/*
+ * An escape-sequence that starts with resetting all markup,
+ * like "\033[0m", "\033[m" and "\033[0;31m".
+ */
+static inline bool resets_markup(const char* escape) {
+	return escape[1] == '['
+		&& (escape[2] == 'm' || (escape[2] == '0' && (escape[3] == 'm' || escape[3] == ';')));
+}
+
+/* Walk the whole line once, leaving a checkpoint every interval of columns */
+static void build_column_checkpoints(
+	wi_line_index* entry, const wi_string_view line
+) {
+	int capacity = line.length.width / WI_COLUMN_CHECKPOINT_INTERVAL + 1;
+	wi_column_checkpoint* checkpoints = (wi_column_checkpoint*) malloc(
+		capacity * sizeof(wi_column_checkpoint)
+	);
+	wiAssert(checkpoints != NULL, "Failed to allocate column-checkpoints");
+
+	wi_column_checkpoint current = { 0, 0 };
+	checkpoints[0] = current;
+	int amount = 1;
+
+	while (current.bytes < line.length.bytes && amount < capacity) {
+		wi_string_length char_length = wi_char_byte_size(line.string + current.bytes);
+		current.bytes += char_length.bytes;
+		current.width += char_length.width;
+
+		/* A wide character can end 1 column past the interval */
+		if (
+			char_length.width > 0
+			&& current.width / WI_COLUMN_CHECKPOINT_INTERVAL
+				!= (current.width - char_length.width) / WI_COLUMN_CHECKPOINT_INTERVAL
+		) {
+			checkpoints[amount] = current;
+			amount++;
+		}
+	}
+
+	entry->checkpoints = checkpoints;
+	entry->amount_checkpoints = amount;
+}
+
+wi_column_checkpoint find_column_checkpoint(
+	const wi_content* content, const int line, const int column
+) {
+	if (content->column_index == NULL || column < WI_COLUMN_CHECKPOINT_INTERVAL) {
+		return (wi_column_checkpoint) { 0, 0 };
+	}
+
+	wi_line_index* entry = line_index(content, line);
+	if (entry->checkpoints == NULL) {
+		build_column_checkpoints(entry, content->line_list[line]);
+	}
+
+	/* Checkpoints lie at fixed intervals, so no need to search */
+	int checkpoint = column / WI_COLUMN_CHECKPOINT_INTERVAL;
+	if (checkpoint >= entry->amount_checkpoints) {
+		checkpoint = entry->amount_checkpoints - 1;
+	}
+	return entry->checkpoints[checkpoint];
+}
+
+/* Walk the whole line once, noting down where its escape-sequences are */
+static void build_style_spans(wi_line_index* entry, const wi_string_view line) {
+	int capacity = 4;
+	wi_style_span* spans = (wi_style_span*) malloc(capacity * sizeof(wi_style_span));
+	wiAssert(spans != NULL, "Failed to allocate style-spans");
+
+	int amount = 0;
+	unsigned int bytes = 0;
+	unsigned int width = 0;
+	while (bytes < line.length.bytes) {
+		const char* c = line.string + bytes;
+		wi_string_length char_length = wi_char_byte_size(c);
+		if (*c == '\033') {
+			if (amount == capacity) {
+				capacity *= 2;
+				spans = (wi_style_span*) realloc(spans, capacity * sizeof(wi_style_span));
+				wiAssert(spans != NULL, "Failed to allocate style-spans");
+			}
+			spans[amount] = (wi_style_span) {
+				bytes, width, char_length.bytes, resets_markup(c)
+			};
+			amount++;
+		}
+		bytes += char_length.bytes;
+		width += char_length.width;
+	}
+
+	entry->spans = spans;
+	entry->amount_spans = amount;
+}
+
+const wi_style_span* find_style_spans(
+	const wi_content* content, const int line, int* amount_spans
+) {
+	/* Most lines have no markup at all, which is quick to rule out */
+	const wi_string_view view = content->line_list[line];
+	if (
+		content->column_index == NULL
+		|| memchr(view.string, '\033', view.length.bytes) == NULL
+	) {
+		*amount_spans = 0;
+		return NULL;
+	}
+
+	wi_line_index* entry = line_index(content, line);
+	if (entry->amount_spans < 0) {
+		build_style_spans(entry, view);
+	}
+	*amount_spans = entry->amount_spans;
+	return entry->spans;
+}
+
+/* Lines of the original start right after a newline */
+static inline bool starts_original_line(const wi_content* content, const int line) {
+	return line == 0 || content->line_list[line].string[-1] == '\n';
+}
+
+wi_carried_style find_carried_style(const wi_content* content, const int line) {
+	const wi_carried_style none = {
+		.known = true, .line = -1, .span = 0, .last_line = -1, .next_line = -1
+	};
+	if (content->column_index == NULL || content->wrap_width == 0) {
+		return none;
+	}
+
+	wi_line_index* entry = line_index(content, line);
+	if (entry->carried.known) {
+		return entry->carried;
+	}
+
+	/* Go back to where it is known, then work it out line by line */
+	int from = line;
+	while (
+		!starts_original_line(content, from)
+		&& !line_index(content, from)->carried.known
+	) {
+		from--;
+	}
+	if (!line_index(content, from)->carried.known) {
+		line_index(content, from)->carried = none;
+	}
+
+	for (int i = from + 1; i <= line; i++) {
+		wi_carried_style carried = line_index(content, i - 1)->carried;
+		carried.next_line = -1;
 
-	int amount_lines = 0;
+		int amount_spans;
+		const wi_style_span* spans = find_style_spans(content, i - 1, &amount_spans);
+		if (amount_spans > 0) {
+			if (carried.last_line >= 0) {
+				line_index(content, carried.last_line)->carried.next_line = i - 1;
+			}
+			carried.last_line = i - 1;
+
+			/* Only the markup since it was last reset matters */
+			int reset = amount_spans - 1;
+			while (reset >= 0 && !spans[reset].resets) {
+				reset--;
+			}
+			if (reset >= 0) {
+				carried.line = i - 1;
+				carried.span = reset;
+			} else if (carried.line < 0) {
+				carried.line = i - 1;
+				carried.span = 0;
+			}
+		}
+		line_index(content, i)->carried = carried;
+	}
+	return entry->carried;
+}
+
+/*
+ * Grow the line-list when the line about to be started doesn't fit anymore.
+ */
+static inline void grow_line_list(
+	wi_string_view** line_list, int* capacity, const int amount_lines
+) {
+	if (amount_lines == *capacity) {
+		*capacity *= 2;
+		*line_list = (wi_string_view*) realloc(
+			*line_list, *capacity * sizeof(wi_string_view)
+		);
+		wiAssert(
+			*line_list != NULL,
+			"Failed to grow array when processing window content."
+		);
+	}
+}
+
+wi_content lazy_split_lines(char* content) {
 	int line_list_capacity = 10;
 	wi_string_view* line_list = (wi_string_view*) malloc(
 		line_list_capacity * sizeof(wi_string_view)
 	);
+	wiAssert(line_list != NULL, "Failed to allocate lines for window content.");
 
 	/* Initialise */
-	INITIALISE_LINE_LIST_EL(0, original.string)
+	INITIALISE_LINE_LIST_EL(0, content)
 
-	int bytes = 0;
-	int chars = 0;
+	return (wi_content) {
+		.original = { .string = content, .length = { 0, 0 } },
+		.line_list = line_list,
+		.amount_lines = 0,
+		.column_index = make_column_index(),
+		.line_list_capacity = line_list_capacity,
+		.fully_split = false
+	};
+}
 
-	while (true) {
-		if (content[bytes] == '\0') {
-			amount_lines++;
-			break;
-		} else if (content[bytes] == '\n') {
-			amount_lines++;
+/*
+ * Content is split in segments of this many bytes, so that the end of the
+ * string is found along the way instead of up front.
+ */
+#define WI_SPLIT_SEGMENT (64 * 1024)
 
-			/* Grow arrays if necessary */
-			if (amount_lines == line_list_capacity) {
-				line_list_capacity *= 2;
-				line_list = (wi_string_view*) realloc(
-					line_list, line_list_capacity * sizeof(wi_string_view)
-				);
-				wiAssert(
-					line_list != NULL,
-					"Failed to grow array when processing window content."
-				);
+static void continue_wrap_lines(wi_content*, const int, const int);
+
+void continue_split_lines(
+	wi_content* content, const int until_lines, const int max_bytes
+) {
+	if (content->wrap_width > 0) {
+		continue_wrap_lines(content, until_lines, max_bytes);
+		return;
+	}
+
+	char* text = content->original.string;
+	wi_string_view* line_list = content->line_list;
+	int line_list_capacity = content->line_list_capacity;
+	int amount_lines = content->amount_lines;
+	int bytes = content->original.length.bytes;
+	int chars = content->original.length.width;
+	bool fully_split = content->fully_split;
+
+	const int stop_bytes =
+		max_bytes > INT_MAX - bytes ? INT_MAX : bytes + max_bytes;
+
+	while (!fully_split && amount_lines < until_lines && bytes < stop_bytes) {
+		/* Look a few bytes further than the segment, so that a character
+		 * crossing the end of the segment can't skip past the nullbyte */
+		const int found = (int) strnlen(text + bytes, WI_SPLIT_SEGMENT + 4);
+		const bool last_segment = found < WI_SPLIT_SEGMENT + 4;
+		const int end = bytes + (last_segment ? found : WI_SPLIT_SEGMENT);
+
+		while (bytes < end && amount_lines < until_lines) {
+#ifdef WI_SIMD_WIDTH
+			if (bytes + WI_SIMD_WIDTH <= end) {
+				const int chunk_start = bytes;
+				const int chunk_end = bytes + WI_SIMD_WIDTH;
+				wi_simd_mask newlines, special;
+				scan_chunk(text + chunk_start, &newlines, &special);
+
+				while (bytes < chunk_end) {
+					/* Everything before the next UTF-8 or escape-byte is plain
+					 * ASCII, where every byte is 1 wide */
+					const wi_simd_mask special_ahead =
+						special & WI_SIMD_FROM(bytes - chunk_start);
+					const int ascii_end = special_ahead == 0
+						? chunk_end : chunk_start + __builtin_ctz(special_ahead);
+					wi_simd_mask newlines_ahead =
+						newlines & WI_SIMD_FROM(bytes - chunk_start);
+
+					while (newlines_ahead != 0) {
+						const int newline = chunk_start + __builtin_ctz(newlines_ahead);
+						if (newline >= ascii_end) {
+							break;
+						}
+						INCREMENT_STR_LEN(line_list[amount_lines].length, newline - bytes)
+						chars += newline - bytes + 1;
+						bytes = newline + 1;
+
+						amount_lines++;
+						grow_line_list(&line_list, &line_list_capacity, amount_lines);
+						INITIALISE_LINE_LIST_EL(amount_lines, text + bytes)
+
+						newlines_ahead &= newlines_ahead - 1;
+					}
+					INCREMENT_STR_LEN(line_list[amount_lines].length, ascii_end - bytes)
+					chars += ascii_end - bytes;
+					bytes = ascii_end;
+
+					if (bytes < chunk_end) {
+						/* Can run past the chunk, which ends this one */
+						wi_string_length char_len = wi_char_byte_size(text + bytes);
+						bytes += char_len.bytes;
+						chars += char_len.width;
+						ADD_STR_LEN(line_list[amount_lines].length, char_len);
+					}
+				}
+				continue;
 			}
+#endif
+			if (text[bytes] == '\n') {
+				amount_lines++;
+				grow_line_list(&line_list, &line_list_capacity, amount_lines);
 
-			bytes++;
-			chars++;
+				bytes++;
+				chars++;
 
-			/* Initialise current line 1 character behind the newline */
-			INITIALISE_LINE_LIST_EL(amount_lines, content + bytes)
-		} else {
-			wi_string_length char_len = wi_char_byte_size(content + bytes);
-			bytes += char_len.bytes;
-			chars += char_len.width;
-			ADD_STR_LEN(line_list[amount_lines].length, char_len);
+				/* Initialise current line 1 character behind the newline */
+				INITIALISE_LINE_LIST_EL(amount_lines, text + bytes)
+			} else {
+				wi_string_length char_len = wi_char_byte_size(text + bytes);
+				bytes += char_len.bytes;
+				chars += char_len.width;
+				ADD_STR_LEN(line_list[amount_lines].length, char_len);
+			}
+		}
+
+		if (last_segment && bytes >= end) {
+			/* The last line is ended by the nullbyte */
+			amount_lines++;
+			fully_split = true;
 		}
 	}
 
-	original.length.width = chars;
-	original.length.bytes = bytes;
+	content->line_list = line_list;
+	content->line_list_capacity = line_list_capacity;
+	content->amount_lines = amount_lines;
+	content->original.length.bytes = bytes;
+	content->original.length.width = chars;
+	content->fully_split = fully_split;
+}
 
-	return (wi_content) {
-		.original = original,
-		.line_list = line_list,
-		.amount_lines = amount_lines
-	};
+wi_content split_lines(char* content) {
+	wi_content result = lazy_split_lines(content);
+	continue_split_lines(&result, INT_MAX, INT_MAX);
+	return result;
 }
 
 bool can_break(char string) {
@@ -144,9 +713,15 @@ wi_string_view calculate_next_line(char* content, unsigned int cols, int* bytes)
 			if (length.width + 1 < cols) {
 				INCREMENT_STR_LEN(length, 1);
 				INCREMENT_STR_LEN(forward, 1);
+				/* The next character could end the line */
+				continue;
 			}
 		}
 		wi_string_length cpl = wi_char_byte_size(content + forward.bytes);
+		if (forward.width + cpl.width > cols && forward.bytes > 0) {
+			/* A wide character that doesn't fit anymore goes to the next line */
+			break;
+		}
 		ADD_STR_LEN(forward, cpl);
 	}
 
@@ -155,6 +730,14 @@ wi_string_view calculate_next_line(char* content, unsigned int cols, int* bytes)
 	}
 
 	if (length.bytes == 0) {
+		/* Zero-width characters stay on the line of the one they belong to */
+		while ((unsigned char) content[forward.bytes] >= 0xC0) {
+			wi_string_length cpl = wi_char_byte_size(content + forward.bytes);
+			if (cpl.width != 0) {
+				break;
+			}
+			ADD_STR_LEN(forward, cpl);
+		}
 		length = forward;
 	}
 
@@ -164,68 +747,875 @@ wi_string_view calculate_next_line(char* content, unsigned int cols, int* bytes)
 	return line;
 }
 
-wi_content split_lines_wrapped(char* content, int cols) {
-	int amount_lines = 0;
+wi_content lazy_wrap_lines(char* content, const int cols, const int from) {
 	int line_list_capacity = 10;
 	wi_string_view* line_list = (wi_string_view*) malloc(
 		line_list_capacity * sizeof(wi_string_view)
 	);
+	wiAssert(line_list != NULL, "Failed to allocate lines for window content.");
+
+	wi_wrap_prefix* prefix = NULL;
+	if (from > 0) {
+		prefix = (wi_wrap_prefix*) malloc(sizeof(wi_wrap_prefix));
+		wiAssert(prefix != NULL, "Failed to allocate prefix for window content.");
+		prefix->lines = (wi_string_view*) malloc(10 * sizeof(wi_string_view));
+		wiAssert(
+			prefix->lines != NULL, "Failed to allocate prefix for window content."
+		);
+		prefix->capacity = 10;
+		prefix->amount_lines = 0;
+		prefix->bytes = 0;
+		prefix->end = from;
+	}
+
+	/* `.original.length.bytes` is how far the content is wrapped */
+	return (wi_content) {
+		.original = { .string = content, .length = { .width = 0, .bytes = from } },
+		.line_list = line_list,
+		.amount_lines = 0,
+		.column_index = make_column_index(),
+		.line_list_capacity = line_list_capacity,
+		.fully_split = false,
+		.wrap_width = cols,
+		.prefix = prefix
+	};
+}
+
+static void continue_wrap_lines(
+	wi_content* content, const int until_lines, const int max_bytes
+) {
+	char* text = content->original.string;
+	int bytes = content->original.length.bytes;
+
+	const int stop_bytes =
+		max_bytes > INT_MAX - bytes ? INT_MAX : bytes + max_bytes;
+
+	while (
+		!content->fully_split && content->amount_lines < until_lines
+		&& bytes < stop_bytes
+	) {
+		/* The end of the last line lies 1 byte past the nullbyte, so the
+		 * end has to be noticed before reading past the string */
+		if (text[bytes] == '\0' || text[bytes + 1] == '\0') {
+			content->fully_split = true;
+			break;
+		}
+
+		content->line_list[content->amount_lines] =
+			calculate_next_line(text + bytes, content->wrap_width, &bytes);
+
+		content->amount_lines++;
+		grow_line_list(
+			&(content->line_list), &(content->line_list_capacity),
+			content->amount_lines
+		);
+
+		if (text[bytes - 1] == '\0') {
+			content->fully_split = true;
+		}
+	}
+
+	content->original.length.bytes = bytes;
+}
+
+/*
+ * Wrap everything from byte `*bytes` up to byte `end`, which has to be the
+ * start of a line (so right after a newline), into `lines`.
+ */
+static void wrap_range(
+	char* text, const int cols, int* bytes, const int end,
+	wi_string_view** lines, int* amount_lines, int* capacity
+) {
+	while (*bytes < end) {
+		(*lines)[*amount_lines] = calculate_next_line(text + *bytes, cols, bytes);
+
+		(*amount_lines)++;
+		grow_line_list(lines, capacity, *amount_lines);
+	}
+}
+
+/* Put `amount` lines in front of the lines of the content */
+static void prepend_lines(
+	wi_content* content, const wi_string_view* lines, const int amount
+) {
+	int capacity = content->line_list_capacity;
+	while (capacity <= content->amount_lines + amount) {
+		capacity *= 2;
+	}
+	if (capacity != content->line_list_capacity) {
+		content->line_list = (wi_string_view*) realloc(
+			content->line_list, capacity * sizeof(wi_string_view)
+		);
+		wiAssert(
+			content->line_list != NULL,
+			"Failed to grow array when processing window content."
+		);
+		content->line_list_capacity = capacity;
+	}
+
+	memmove(
+		content->line_list + amount, content->line_list,
+		content->amount_lines * sizeof(wi_string_view)
+	);
+	memcpy(content->line_list, lines, amount * sizeof(wi_string_view));
+	content->amount_lines += amount;
+
+	/* Every line got a different line-number */
+	free_column_index(content->column_index);
+	content->column_index = make_column_index();
+}
+
+static void free_wrap_prefix(wi_content* content) {
+	free(content->prefix->lines);
+	free(content->prefix);
+	content->prefix = NULL;
+}
+
+bool continue_wrap_prefix(wi_content* content, const int max_bytes) {
+	wi_wrap_prefix* prefix = content->prefix;
+	const int end = prefix->end - prefix->bytes > max_bytes
+		? prefix->bytes + max_bytes : prefix->end;
+
+	/* A line starting before `.end` also ends before it, so this never
+	 * wraps past it */
+	wrap_range(
+		content->original.string, content->wrap_width, &(prefix->bytes), end,
+		&(prefix->lines), &(prefix->amount_lines), &(prefix->capacity)
+	);
+
+	return prefix->bytes >= prefix->end;
+}
+
+/* Whether every escape-sequence in `text` ends in it */
+static bool escapes_end_in_line(const char* text, const int length) {
+	const char* end = text + length;
+	const char* escape = memchr(text, '\033', length);
+	while (escape != NULL) {
+		const char* escape_end = memchr(escape + 1, 'm', end - escape - 1);
+		if (escape_end == NULL) {
+			return false;
+		}
+		escape = memchr(escape_end + 1, '\033', end - escape_end - 1);
+	}
+
+	return true;
+}
+
+/* Whether one of the last 3 bytes of `text` could start a longer character */
+static bool ends_in_lead_byte(const char* text, const int length) {
+	for (int i = length - 1; i >= 0 && i >= length - 3; i--) {
+		if ((unsigned char) text[i] >= 0xC0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int count_wrap_prefix_lines(const wi_content* content) {
+	const wi_wrap_prefix* prefix = content->prefix;
+	char* text = content->original.string;
+	const int cols = content->wrap_width;
+
+	int amount = prefix->amount_lines;
+	int bytes = prefix->bytes;
+	while (bytes < prefix->end) {
+		const char* newline = memchr(text + bytes, '\n', prefix->end - bytes);
+		const int line_end = newline == NULL ? prefix->end : newline - text + 1;
+
+		/* Every character is at least as many bytes as it is wide, so a line
+		 * with less bytes than `cols` always fits. Unless an escape without
+		 * its 'm', or a lead-byte at its end, runs on past the newline */
+		if (
+			line_end - 1 - bytes < cols
+			&& escapes_end_in_line(text + bytes, line_end - 1 - bytes)
+			&& !ends_in_lead_byte(text + bytes, line_end - 1 - bytes)
+		) {
+			amount++;
+			bytes = line_end;
+			continue;
+		}
+		while (bytes < line_end) {
+			calculate_next_line(text + bytes, cols, &bytes);
+			amount++;
+		}
+	}
+
+	return amount;
+}
+
+int merge_wrap_prefix(wi_content* content) {
+	const int amount = content->prefix->amount_lines;
+	prepend_lines(content, content->prefix->lines, amount);
+	free_wrap_prefix(content);
+
+	return amount;
+}
+
+/*
+ * Wrap the line of the original content right before the wrapped lines,
+ * and put it in front of them.
+ *
+ * @returns: the amount of lines it was wrapped into
+ */
+static int wrap_previous_line(wi_content* content) {
+	wi_wrap_prefix* prefix = content->prefix;
+	char* text = content->original.string;
+
+	/* `.end` lies right behind a newline */
+	int start = prefix->end - 1;
+	while (start > 0 && text[start - 1] != '\n') {
+		start--;
+	}
+
+	int bytes = start;
+	int amount = 0;
+	int capacity = 10;
+	wi_string_view* lines = (wi_string_view*) malloc(
+		capacity * sizeof(wi_string_view)
+	);
+	wiAssert(lines != NULL, "Failed to allocate lines for window content.");
+
+	wrap_range(
+		text, content->wrap_width, &bytes, prefix->end, &lines, &amount, &capacity
+	);
+	prepend_lines(content, lines, amount);
+	free(lines);
+
+	/* The prefix could already be wrapped past the new end */
+	prefix->end = start;
+	while (
+		prefix->amount_lines > 0
+		&& prefix->lines[prefix->amount_lines - 1].string >= text + start
+	) {
+		prefix->amount_lines--;
+	}
+	if (prefix->bytes > start) {
+		prefix->bytes = start;
+	}
+	if (start == 0) {
+		free_wrap_prefix(content);
+	}
+
+	return amount;
+}
+
+wi_content split_lines_wrapped(char* content, int cols) {
+	wi_content result = lazy_wrap_lines(content, cols, 0);
+	continue_split_lines(&result, INT_MAX, INT_MAX);
+	return result;
+}
+
+/* Bytes the wrapped lines of the content take up */
+static size_t wrap_memory(const wi_content* content) {
+	size_t lines = content->line_list_capacity;
+	if (content->prefix != NULL) {
+		lines += content->prefix->capacity;
+	}
+	return lines * sizeof(wi_string_view);
+}
+
+static void remove_cache_entry(wi_wrap_cache* cache, const int entry) {
+	cache->amount_entries--;
+	memmove(
+		cache->entries + entry, cache->entries + entry + 1,
+		(cache->amount_entries - entry) * sizeof(wi_content)
+	);
+}
+
+/*
+ * Move the wrapped lines of the content into its wrap-cache, and drop the
+ * least recently used widths until the cache fits in `cache_size` bytes.
+ * Afterwards, the content has no lines.
+ */
+static void cache_wrapped_lines(wi_content* content, const size_t cache_size) {
+	wi_wrap_cache* cache = content->wrap_cache;
+	content->wrap_cache = NULL;
+
+	if (
+		content->line_list != NULL
+		&& (
+			content->wrap_width <= 0 || content->amount_lines == 0
+			|| wrap_memory(content) > cache_size
+		)
+	) {
+		wi_free_content(*content);
+	} else if (content->line_list != NULL) {
+		if (cache == NULL) {
+			cache = (wi_wrap_cache*) calloc(1, sizeof(wi_wrap_cache));
+			wiAssert(cache != NULL, "Failed to allocate wrap-cache.");
+		}
+		if (cache->amount_entries == WI_WRAP_CACHE_ENTRIES) {
+			wi_free_content(cache->entries[WI_WRAP_CACHE_ENTRIES - 1]);
+			cache->amount_entries--;
+		}
+		memmove(
+			cache->entries + 1, cache->entries,
+			cache->amount_entries * sizeof(wi_content)
+		);
+		cache->entries[0] = *content;
+		cache->amount_entries++;
+
+		size_t used = 0;
+		int fitting = 0;
+		while (fitting < cache->amount_entries) {
+			used += wrap_memory(&(cache->entries[fitting]));
+			if (used > cache_size) {
+				break;
+			}
+			fitting++;
+		}
+		while (cache->amount_entries > fitting) {
+			wi_free_content(cache->entries[cache->amount_entries - 1]);
+			cache->amount_entries--;
+		}
+	}
+
+	content->line_list = NULL;
+	content->amount_lines = 0;
+	content->line_list_capacity = 0;
+	content->column_index = NULL;
+	content->prefix = NULL;
+	content->wrap_cache = cache;
+}
 
-	int bytes = 0;
+/* Drop everything in the wrap-cache of the content */
+static void clear_wrap_cache(wi_content* content) {
+	wi_wrap_cache* cache = content->wrap_cache;
+	if (cache == NULL) {
+		return;
+	}
+	for (int i = 0; i < cache->amount_entries; i++) {
+		wi_free_content(cache->entries[i]);
+	}
+	cache->amount_entries = 0;
+}
+
+/*
+ * Put the cached lines for `width` back into the content, which has no
+ * lines.
+ *
+ * @returns: whether there were any
+ */
+static bool take_cached_lines(wi_content* content, const int width) {
+	wi_wrap_cache* cache = content->wrap_cache;
+	if (cache == NULL) {
+		return false;
+	}
+
+	for (int i = 0; i < cache->amount_entries; i++) {
+		if (cache->entries[i].wrap_width == width) {
+			*content = cache->entries[i];
+			content->wrap_cache = cache;
+			remove_cache_entry(cache, i);
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Where the line the cursor of the window is on starts in the original */
+static int cursor_anchor(const wi_window* window, const wi_content* content) {
+	if (content->line_list == NULL || content->amount_lines == 0) {
+		return 0;
+	}
 
-	while (content[bytes] != '\0' && content[bytes + 1] != '\0') {
-		line_list[amount_lines] = calculate_next_line(content + bytes, cols, &bytes);
+	int row =
+		window->internal.offset_cursor.row + window->internal.visual_cursor.row;
+	if (row >= content->amount_lines) {
+		row = content->amount_lines - 1;
+	}
+	const int anchor =
+		(int) (content->line_list[row].string - content->original.string);
+
+	/* The content could have been changed to something shorter */
+	return (int) strnlen(content->original.string, anchor);
+}
+
+/*
+ * Put the cursor of the window on the line of the content that byte `anchor`
+ * of the original lies in. It stays on the same row of the window where
+ * possible, only the lines needed to fill the rows above it are wrapped
+ * before it.
+ */
+static void anchor_cursor(
+	wi_window* window, wi_content* content, const int anchor
+) {
+	wi_position* visual = &(window->internal.visual_cursor);
+	wi_position* offset = &(window->internal.offset_cursor);
+
+	while (
+		!content->fully_split && (int) content->original.length.bytes <= anchor
+	) {
+		continue_split_lines(content, content->amount_lines + 1, INT_MAX);
+	}
+
+	/* The last line starting at or before the anchor */
+	const char* anchor_string = content->original.string + anchor;
+	int cursor_row = 0;
+	int last = content->amount_lines - 1;
+	while (cursor_row < last) {
+		const int middle = cursor_row + (last - cursor_row + 1) / 2;
+		if (content->line_list[middle].string <= anchor_string) {
+			cursor_row = middle;
+		} else {
+			last = middle - 1;
+		}
+	}
+
+	while (content->prefix != NULL && cursor_row < visual->row) {
+		cursor_row += wrap_previous_line(content);
+	}
 
-		amount_lines++;
-		if (amount_lines >= line_list_capacity) {
-			line_list = (wi_string_view*) realloc(
-				line_list, line_list_capacity * 2 * sizeof(wi_string_view)
+	if (visual->row >= window->internal.rendered_height) {
+		visual->row = window->internal.rendered_height - 1;
+	}
+	if (visual->row > cursor_row) {
+		visual->row = cursor_row;
+	}
+	if (visual->row < 0) {
+		visual->row = 0;
+	}
+	offset->row = cursor_row - visual->row;
+}
+
+/*
+ * Rewrap content of a window for a new width.
+ * Lines cached for that width are used when possible, otherwise it gets
+ * wrapped lazily. The content the window currently shows starts wrapping at
+ * the line of the cursor, which stays on that same line.
+ */
+static void rewrap_content(
+	wi_window* window, wi_content* content, const bool current,
+	const int width, const size_t cache_size
+) {
+	char* text = content->original.string;
+	const int anchor = current ? cursor_anchor(window, content) : 0;
+
+	/* The windows depending on this one need actual line-numbers, and so
+	 * does content that isn't shown, so those have to be wrapped from the
+	 * start */
+	const bool anchored = current && window->internal.amount_depending == 0;
+
+	cache_wrapped_lines(content, cache_size);
+	if (
+		take_cached_lines(content, width)
+		&& content->prefix != NULL
+		&& (!anchored || anchor < content->prefix->end)
+	) {
+		/* Its lines start after the cursor */
+		wi_wrap_cache* cache = content->wrap_cache;
+		content->wrap_cache = NULL;
+		wi_free_content(*content);
+		content->line_list = NULL;
+		content->wrap_cache = cache;
+	}
+
+	if (content->line_list == NULL) {
+		int from = 0;
+		if (anchored) {
+			from = anchor;
+			while (from > 0 && text[from - 1] != '\n') {
+				from--;
+			}
+		}
+
+		wi_wrap_cache* cache = content->wrap_cache;
+		const size_t mapped_size = content->mapped_size;
+		const size_t appendable_capacity = content->appendable_capacity;
+		const size_t appendable_length = content->appendable_length;
+		*content = lazy_wrap_lines(text, width, from);
+		content->wrap_cache = cache;
+		content->mapped_size = mapped_size;
+		content->appendable_capacity = appendable_capacity;
+		content->appendable_length = appendable_length;
+	}
+
+	if (current) {
+		anchor_cursor(window, content, anchor);
+	}
+}
+
+/*
+ * Rewrap all content of a wrapping window for its rendered width.
+ * When the content itself changed, nothing wrapped before can be reused.
+ */
+static void rewrap_window(wi_window* window, const bool changed) {
+	const int width = window->internal.rendered_width;
+	const wi_session* session = window->internal.session;
+	const size_t cache_size = session != NULL && !changed
+		? session->wrap_cache_size : 0;
+
+	wi_content* current = NULL;
+	for (int i = 0; i < window->internal.content_grid_row_capacity; i++) {
+		if (window->content_grid[i] == NULL) continue;
+		for (int j = 0; j < window->internal.content_grid_col_capacity[i]; j++) {
+			wi_content* content = &(window->content_grid[i][j]);
+			if (content->original.string == NULL) continue;
+			/* It would be cut off at the window edge instead */
+			wiAssertCallback(
+				content->ring == NULL, restore_terminal(),
+				"Bounded content can't be wrapped, turn off wrap_text"
 			);
-			wiAssert(line_list != NULL, "Failed to reallocate line_list");
-			line_list_capacity *= 2;
+			if (current == NULL) {
+				current = current_window_content(window);
+			}
+
+			if (changed) {
+				clear_wrap_cache(content);
+			} else if (content->line_list != NULL && content->wrap_width == width) {
+				continue;
+			}
+			rewrap_content(window, content, content == current, width, cache_size);
 		}
 	}
+}
 
-	/* NOTE: I'm not keeping track of size here, as I don't think I need it? */
-	wi_string_view original = {
-		.string = content
-	};
+/* Forget the checkpoints and spans of the lines from `line` on, as they changed */
+static void forget_column_checkpoints(wi_column_index* index, const int line) {
+	for (int i = line; i < index->amount_lines; i++) {
+		forget_line_index(&(index->lines[index->first_line + i]));
+	}
+}
+
+/*
+ * Forget the checkpoints and spans of the first `amount` lines, which were
+ * evicted. The others only move down once half of the array is unused.
+ */
+static void evict_column_checkpoints(wi_column_index* index, const int amount) {
+	if (amount >= index->amount_lines) {
+		forget_column_checkpoints(index, 0);
+		index->amount_lines = 0;
+		index->first_line = 0;
+		return;
+	}
+
+	for (int i = 0; i < amount; i++) {
+		forget_line_index(&(index->lines[index->first_line + i]));
+	}
+	index->first_line += amount;
+	index->amount_lines -= amount;
+	if (index->first_line > index->amount_lines) {
+		memmove(
+			index->lines, index->lines + index->first_line,
+			index->amount_lines * sizeof(wi_line_index)
+		);
+		index->first_line = 0;
+	}
+}
+
+/* Move the original of the content to `string`, which holds a copy */
+static void move_original(wi_content* content, char* string) {
+	char* old = content->original.string;
+
+	if (content->line_list != NULL) {
+		/* Lazily split content also has a line being split */
+		const int amount_lines = content->amount_lines
+			+ (content->wrap_width == 0 && !content->fully_split ? 1 : 0);
+		for (int i = 0; i < amount_lines; i++) {
+			content->line_list[i].string =
+				string + (content->line_list[i].string - old);
+		}
+	}
+	if (content->prefix != NULL) {
+		for (int i = 0; i < content->prefix->amount_lines; i++) {
+			content->prefix->lines[i].string =
+				string + (content->prefix->lines[i].string - old);
+		}
+	}
+
+	if (content->mapped_size > 0) {
+		munmap(old, content->mapped_size);
+		content->mapped_size = 0;
+	} else if (content->appendable_capacity > 0) {
+		free(old);
+	}
+	content->original.string = string;
+}
+
+/*
+ * Let splitting continue with the last line, when it was ended by the
+ * nullbyte at `old_length` that now has text after it.
+ */
+static void reopen_last_line(wi_content* content, const int old_length) {
+	/* Splitting that didn't reach the old end yet continues by itself */
+	if (content->line_list == NULL || !content->fully_split) {
+		return;
+	}
+
+	char* string = content->original.string;
+	if (content->wrap_width > 0) {
+		/* The lines of the last line of the original get wrapped again */
+		int start = old_length;
+		while (start > 0 && string[start - 1] != '\n') {
+			start--;
+		}
+		while (
+			content->amount_lines > 0
+			&& content->line_list[content->amount_lines - 1].string >= string + start
+		) {
+			content->amount_lines--;
+		}
+		/* Wrapping can also have stopped right before the old end */
+		if ((int) content->original.length.bytes > start) {
+			content->original.length.bytes = start;
+		}
+	} else {
+		/* The last line was ended by the nullbyte, and continues now */
+		content->amount_lines--;
+	}
+	content->fully_split = false;
+	forget_column_checkpoints(content->column_index, content->amount_lines);
+}
+
+wi_content bounded_content(wi_ring* ring) {
+	wi_string_view* line_list = ring->lines;
+	ring->text[0] = '\0';
+
+	/* Initialise */
+	INITIALISE_LINE_LIST_EL(0, ring->text)
 
 	return (wi_content) {
-		.original = original,
+		.original = { .string = ring->text, .length = { 0, 0 } },
 		.line_list = line_list,
-		.amount_lines = amount_lines
+		.amount_lines = 0,
+		.column_index = make_column_index(),
+		.line_list_capacity = ring->line_capacity,
+		.fully_split = false,
+		.ring = ring
 	};
 }
 
-void update_wrapped_content(wi_content* content, int width) {
-	wi_content new_content = split_lines_wrapped(content->original.string, width);
-	wi_free_content(*content);
-	*content = new_content;
+/*
+ * Move the start of bounded content `bytes` forward. Once it lies in the
+ * second mapping of the text, everything moves back to the first one, so
+ * that the text can't run past the end of the second.
+ */
+static void advance_ring_start(wi_content* content, const int bytes) {
+	const wi_ring* ring = content->ring;
+
+	content->original.string += bytes;
+	content->original.length.bytes -= bytes;
+	content->appendable_length -= bytes;
+
+	if (content->original.string >= ring->text + ring->text_size) {
+		content->original.string -= ring->text_size;
+		const int amount_lines =
+			content->amount_lines + (content->fully_split ? 0 : 1);
+		for (int i = 0; i < amount_lines; i++) {
+			content->line_list[i].string -= ring->text_size;
+		}
+	}
+}
+
+/*
+ * Evict the first `amount` lines of bounded content, which have to be done
+ * already. Only the starts of the text and the lines move, the line-list
+ * continues at the start of its mapping when it runs past the end.
+ */
+static void evict_lines(wi_content* content, const int amount) {
+	const wi_ring* ring = content->ring;
+	wi_string_view* line_list = content->line_list;
+
+	const int bytes = (int) (line_list[amount].string - line_list[0].string);
+	int chars = 0;
+	for (int i = 0; i < amount; i++) {
+		chars += line_list[i].length.width + 1;
+	}
+	content->original.length.width -= chars;
+
+	line_list += amount;
+	if (line_list >= ring->lines + ring->line_capacity) {
+		line_list -= ring->line_capacity;
+	}
+	content->line_list = line_list;
+	content->amount_lines -= amount;
+	evict_column_checkpoints(content->column_index, amount);
+
+	advance_ring_start(content, bytes);
 }
 
-void update_content(wi_content* content) {
-	wi_content new_content = split_lines(content->original.string);
+/* Append to bounded content, see `append_to_content()` */
+static int append_to_ring(wi_content* content, const char* text, size_t length) {
+	const wi_ring* ring = content->ring;
+	const size_t max_bytes = (size_t) ring->max_bytes;
+	int evicted = 0;
+
+	/* Only the end of the text can be kept anyway */
+	if (length > max_bytes) {
+		size_t skip = length - max_bytes;
+		while (skip < length && (text[skip] & 0xC0) == 0x80) {
+			skip++;
+		}
+		text += skip;
+		length -= skip;
+	}
+
+	reopen_last_line(content, (int) content->appendable_length);
+
+	/* Make room by evicting the oldest lines */
+	if (content->appendable_length + length > max_bytes) {
+		const int need = (int) (content->appendable_length + length - max_bytes);
+		const char* new_start = content->original.string + need;
+		int amount = 0;
+		while (
+			amount < content->amount_lines
+			&& content->line_list[amount].string < new_start
+		) {
+			amount++;
+		}
+		if (amount > 0) {
+			evict_lines(content, amount);
+			evicted += amount;
+		}
+	}
+	if (content->appendable_length + length > max_bytes) {
+		/* The line being written is too long, so it loses its start */
+		int cut = (int) (content->appendable_length + length - max_bytes);
+		const char* string = content->original.string;
+		while (
+			cut < (int) content->appendable_length && (string[cut] & 0xC0) == 0x80
+		) {
+			cut++;
+		}
+		forget_column_checkpoints(content->column_index, 0);
+		content->original.length.bytes = cut;
+		content->original.length.width = 0;
+		advance_ring_start(content, cut);
+
+		wi_string_view* line_list = content->line_list;
+		INITIALISE_LINE_LIST_EL(0, content->original.string)
+	}
+
+	char* end = content->original.string + content->appendable_length;
+	memcpy(end, text, length);
+	end[length] = '\0';
+	content->appendable_length += length;
+
+	/* Split right away, as evicting needs to know where the lines are */
+	while (!content->fully_split) {
+		continue_split_lines(content, ring->max_lines + 1, INT_MAX);
+
+		/* The line being written doesn't count */
+		const int excess = content->amount_lines - ring->max_lines
+			- (content->fully_split ? 1 : 0);
+		if (excess > 0) {
+			evict_lines(content, excess);
+			evicted += excess;
+		}
+	}
+
+	return evicted;
+}
+
+int append_to_content(
+	wi_content* content, const char* text, const size_t length
+) {
+	if (content->ring != NULL) {
+		return append_to_ring(content, text, length);
+	}
+
+	/* Lines wrapped for other widths don't know about the new text */
+	clear_wrap_cache(content);
+
+	if (content->appendable_capacity == 0) {
+		content->appendable_length = strlen(content->original.string);
+		content->appendable_capacity = content->appendable_length + 1;
+		char* copy = (char*) malloc(content->appendable_capacity);
+		wiAssert(copy != NULL, "Failed to allocate appendable content.");
+		memcpy(copy, content->original.string, content->appendable_capacity);
+		move_original(content, copy);
+	}
+
+	const size_t old_length = content->appendable_length;
+	wiAssert(
+		old_length + length < INT_MAX, "Content can't grow past 2 GiB."
+	);
+	if (old_length + length + 1 > content->appendable_capacity) {
+		size_t capacity = content->appendable_capacity * 2;
+		while (capacity < old_length + length + 1) {
+			capacity *= 2;
+		}
+		char* grown = (char*) malloc(capacity);
+		wiAssert(grown != NULL, "Failed to grow appendable content.");
+		memcpy(grown, content->original.string, old_length + 1);
+		move_original(content, grown);
+		content->appendable_capacity = capacity;
+	}
+
+	memcpy(content->original.string + old_length, text, length + 1);
+	content->appendable_length = old_length + length;
+	reopen_last_line(content, (int) old_length);
+
+	return 0;
+}
+
+void update_content(wi_content* content, const bool lazy) {
+	wi_content new_content = lazy
+		? lazy_split_lines(content->original.string)
+		: split_lines(content->original.string);
+	new_content.mapped_size = content->mapped_size;
+	new_content.appendable_capacity = content->appendable_capacity;
+	new_content.appendable_length = content->appendable_length;
 	wi_free_content(*content);
 	*content = new_content;
 }
 
+void resize_window_content(wi_window* window) {
+	if (!window->wrap_text) {
+		return;
+	}
+
+	rewrap_window(window, false);
+	atomic_store(&(window->internal.dirty), true);
+}
+
 wi_window* wi_update_content(wi_window* window) {
-	int width = window->internal.rendered_width;
+	wi_session* session = window->internal.session;
+	const bool collect_stats = session != NULL && session->collect_stats;
+	const long long start = collect_stats ? monotonic_ns() : 0;
 
-	for (int i = 0; i < window->internal.content_grid_row_capacity; i++) {
-		if (window->content_grid[i] == NULL) continue;
-		for (int j = 0; j < window->internal.content_grid_col_capacity[i]; j++) {
-			if (window->content_grid[i][j].original.string == NULL) {
-				continue;
-			}
-			if (window->wrap_text) {
-				update_wrapped_content(&(window->content_grid[i][j]), width);
-			} else {
-				update_content(&(window->content_grid[i][j]));
+	lock_content(session);
+	if (window->wrap_text) {
+		rewrap_window(window, true);
+	} else {
+		for (int i = 0; i < window->internal.content_grid_row_capacity; i++) {
+			if (window->content_grid[i] == NULL) continue;
+			for (int j = 0; j < window->internal.content_grid_col_capacity[i]; j++) {
+				/* Bounded content is split as it's appended */
+				if (
+					window->content_grid[i][j].original.string == NULL
+					|| window->content_grid[i][j].ring != NULL
+				) {
+					continue;
+				}
+				update_content(
+					&(window->content_grid[i][j]), window->lazy_content
+				);
 			}
 		}
 	}
+	atomic_store(&(window->internal.dirty), true);
+	unlock_content(session);
+
+	if (collect_stats) {
+		const long long elapsed = monotonic_ns() - start;
+		mtx_lock(&(session->internal.stats_lock));
+		session->internal.stats.update_content_ns += elapsed;
+		mtx_unlock(&(session->internal.stats_lock));
+	}
+	if (session != NULL) {
+		request_rerender(session);
+	}
+
+	return window;
+}
+
+wi_window* wi_mark_window_dirty(wi_window* window) {
+	atomic_store(&(window->internal.dirty), true);
+	if (window->internal.session != NULL) {
+		request_rerender(window->internal.session);
+	}
 
 	return window;
 }
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""
+Generates src/width_table.c, the widths of all Unicode characters as a
+two-stage table: the first stage gives the block of 256 characters a
+character lies in, the second the widths in that block, 2 bits each.
+Blocks that are the same are only stored once.
+
+Widths come from the Unicode database of Python's `unicodedata`:
+- 0 for combining marks, format characters and the C1 control characters
+- 2 for East Asian Wide and Fullwidth characters
+- 1 for everything else
+
+Usage: python3 tools/width_table.py > src/width_table.c
+"""
+
+import unicodedata
+
+BLOCK_SIZE = 256
+MAX_CODEPOINT = 0x10FFFF
+
+
+def width(codepoint):
+    # Surrogates can't be encoded in UTF-8 anyway
+    if 0xD800 <= codepoint <= 0xDFFF:
+        return 1
+    # ASCII never gets here, but keeps the width it always had
+    if codepoint < 0x80:
+        return 1
+    if codepoint <= 0x9F:
+        return 0
+
+    character = chr(codepoint)
+    category = unicodedata.category(character)
+    if category in ("Mn", "Me"):
+        return 0
+    # The soft hyphen is shown where a line gets broken
+    if category == "Cf" and codepoint != 0x00AD:
+        return 0
+    # Hangul vowels and final consonants join the syllable before them
+    if 0x1160 <= codepoint <= 0x11FF:
+        return 0
+
+    if unicodedata.east_asian_width(character) in ("W", "F"):
+        return 2
+    # Ideographs that are not assigned yet will be wide as well
+    if 0x20000 <= codepoint <= 0x2FFFD or 0x30000 <= codepoint <= 0x3FFFD:
+        return 2
+    return 1
+
+
+def pack(widths):
+    packed = []
+    for i in range(0, len(widths), 4):
+        byte = 0
+        for j in range(4):
+            byte |= widths[i + j] << (2 * j)
+        packed.append(byte)
+    return tuple(packed)
+
+
+def main():
+    blocks = []
+    block_numbers = {}
+    stage_1 = []
+
+    for start in range(0, MAX_CODEPOINT + 1, BLOCK_SIZE):
+        block = pack([width(c) for c in range(start, start + BLOCK_SIZE)])
+        if block not in block_numbers:
+            block_numbers[block] = len(blocks)
+            blocks.append(block)
+        stage_1.append(block_numbers[block])
+
+    assert len(blocks) <= 256, "Block numbers have to fit in a byte"
+
+    print("/*")
+    print(" * Generated by tools/width_table.py from Unicode "
+          f"{unicodedata.unidata_version}, do not edit.")
+    print(" */")
+    print()
+    print('#include "wi_internals.h"')
+    print()
+    print(f"const unsigned char width_table_blocks[{len(stage_1)}] = {{")
+    for i in range(0, len(stage_1), 16):
+        row = ", ".join(f"{n:3}" for n in stage_1[i:i + 16])
+        print(f"\t{row},")
+    print("};")
+    print()
+    print(f"const unsigned char width_table_widths[{len(blocks)}]"
+          f"[WI_WIDTH_BLOCK_BYTES] = {{")
+    for block in blocks:
+        print("\t{")
+        for i in range(0, len(block), 16):
+            row = ", ".join(f"0x{b:02x}" for b in block[i:i + 16])
+            print(f"\t\t{row},")
+        print("\t},")
+    print("};")
+
+
+if __name__ == "__main__":
+    main()